@@ -0,0 +1,74 @@
+// https://github.com/boris-dimitrov/z4_planar_langford
+//
+// Library interface to the planar Langford solver in planar_mt.cpp, for programs that
+// embed the enumeration instead of parsing its output.  Build planar_mt.cpp without
+// its main() and link it in:
+//
+//     g++ -O3 -std=c++11 -DNDEBUG -DPLANAR_LANGFORD_NO_MAIN -c planar_mt.cpp
+//     g++ -O3 -std=c++11 -o analysis analysis.cpp planar_mt.o -lpthread
+//
+// Both calls below run the same multi-threaded search as the program, but keep no
+// solutions in memory:  each solution is recognized as the canonical one of its
+// top-bottom twins when the search reaches it, so nothing needs to be sorted or
+// deduplicated afterwards.  See LIBRARY at the top of planar_mt.cpp.
+
+#ifndef PLANAR_LANGFORD_H
+#define PLANAR_LANGFORD_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+
+struct PlanarLangfordOptions {
+    int num_threads = 0;        // worker threads;  0 means one per CPU available
+    int split_depth = 0;        // depth of the frontier tasks;  0 means choose at run time
+};
+
+struct PlanarLangfordStats {
+    int64_t solutions = 0;      // unique solutions, up to left-right reversal
+    int64_t nodes = 0;          // search tree nodes visited
+    int split_depth = 0;
+    int64_t num_tasks = 0;      // frontier tasks the search was cut into
+    double seconds = 0;         // wall time
+};
+
+// Called once per unique solution with its sequence s[0..length-1], length = 2n, in
+// which the two occurrences of each m = 1..n have m other numbers between them.  It is
+// the one of the solution and its reversal that has 1 closing at position <= n, as
+// planar_mt --emit writes it.  The sequence lives on the calling worker's stack and is
+// valid only during the call.  Calls come from all worker threads concurrently, so the
+// visitor must be thread-safe;  while it runs, that worker does not search.
+typedef std::function<void(const int* sequence, int length)> PlanarLangfordVisitor;
+
+// Count the planar Langford sequences of 1, 1, 2, 2, ..., n, n.  Only n in 1..63 are
+// supported;  any other n returns all zeros.
+PlanarLangfordStats count_planar_langford(int n, const PlanarLangfordOptions& options = PlanarLangfordOptions());
+
+// Count them and pass each one to visitor as the search finds it.
+PlanarLangfordStats for_each_planar_langford(int n, const PlanarLangfordVisitor& visitor,
+                                             const PlanarLangfordOptions& options = PlanarLangfordOptions());
+
+// Pull-based enumeration on the calling thread.  Each next() resumes the search where
+// the previous one left off and stops at the next solution, so a consumer can take the
+// first K solutions, or feed a slow sink at its own pace, while the generator holds
+// only a small stack of pending subtrees.  Shard s of num_shards yields the solutions
+// under every num_shards-th frontier task, starting with task s;  together the shards
+// yield every solution exactly once, so they can run in separate threads or processes.
+// Each shard yields its solutions in the same order on every run.
+class PlanarLangfordGenerator {
+  public:
+    PlanarLangfordGenerator(int n, int shard = 0, int num_shards = 1);
+    ~PlanarLangfordGenerator();
+    PlanarLangfordGenerator(const PlanarLangfordGenerator&) = delete;
+    PlanarLangfordGenerator& operator=(const PlanarLangfordGenerator&) = delete;
+
+    // Store the next solution in sequence[0..2n-1], in the form passed to a
+    // PlanarLangfordVisitor, and return true;  or return false once there are no more.
+    bool next(int* sequence);
+
+  private:
+    struct State;                   // the suspended search, defined in planar_mt.cpp
+    std::unique_ptr<State> state;
+};
+
+#endif
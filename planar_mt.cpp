@@ -14,7 +14,13 @@
 //
 //     g++ -O3 -std=c++11 -DNDEBUG -o planar_mt planar_mt.cpp -lpthread
 //
-// The resulting executable will be named "planar_mt".
+// The resulting executable will be named "planar_mt".  Run without arguments, it
+// solves n = 3, 4, 7, 8, ..., 27, 28 in turn.  To solve only specific n, list them
+// on the command line, e.g.
+//
+//     ./planar_mt 31 32 35 36
+//
+// Any n from 1 to 63 is accepted.
 //
 //
 // THE ALGORITHM
@@ -31,6 +37,13 @@
 // When the number of open pairs reaches n, opening new pairs is no longer possible.
 // Observing this constraint greatly prunes the search tree.
 //
+// The oldest pair that is still open (on either side) can be closed at the current
+// position at the earliest, which requires a number at least as large as its current
+// distance.  If the largest number still available is smaller than that, no completion
+// exists and the branch is cut.  This "dead opening" check costs two bit scans per node
+// and reduces the number of search nodes 6.5-fold for n = 15, 7.8-fold for n = 16
+// and 13-fold for n = 19;  the gain keeps growing with n.
+//
 // The matching "open" at k' is very easy to find using two auxiliary stacks of
 // currently open pairs, one for "below" and one for "above".
 //
@@ -44,13 +57,22 @@
 //
 // Remaining duplicates are eliminated by storing all solutions in memory,
 // with a final sort and count.  Fortunately, the number of solutions to the
-// planar Langford problem is quite small, so this is feasible.
+// planar Langford problem is quite small, so this is feasible.  When it is not,
+// "--mem-budget SIZE" (e.g. 512M or 4G) caps the memory used for raw solutions:
+// each time the buffer fills up it is sorted, deduplicated and spilled to an
+// unlinked temporary file under "--spill-dir DIR" (default $TMPDIR, or /tmp), and
+// the final count is a streaming k-way merge of those runs.
+//
+// Each stored solution is packed into a fixed-width integer key, 6 bits per closing
+// position (7 bits when n > 32), and the keys are deduplicated with a parallel LSD
+// radix sort.  For n = 28 a key is 3 words, and sorting a million of them takes a
+// few dozen byte-wide passes over memory instead of a comparison sort.
 //
 //
 // IMPLEMENTATION TRICKS
 //
-// A nice boost in performance is realized through the use of a single 64-bit
-// integer to encode the positions of *all* currently open pairs;  in this compact
+// A nice boost in performance is realized through the use of a single integer
+// to encode the positions of *all* currently open pairs;  in this compact
 // representation, we can quickly "pop" the position of the most recently open pair
 // by using the operations
 //
@@ -60,6 +82,12 @@
 //
 //     x &= (x-1)    clear the least signifficant 1-bit of x
 //
+// The width of that integer is a template parameter of dfs<n, Word>.  By default
+// Word<n> is the narrowest of uint32_t, uint64_t and unsigned __int128 that has
+// room for 2*n bits, so n <= 16 runs on 32-bit words, n <= 32 on 64-bit words,
+// and n <= 63 on 128-bit words.  Each width has its own overload of the bit scans
+// below, so the small cases do not pay for the large ones.
+//
 //
 // EXAMPLE OUTPUT
 //
@@ -84,10 +112,284 @@
 //         tm_sec=34, tm_wday=0, tm_yday=58, tm_isdst=0)
 //
 //
-// PRINTING ALL SOLUTION SEQUENCES
+// EMITTING ALL SOLUTION SEQUENCES
+//
+// To write every unique solution to a file, pass
+//
+//     --emit FILE                 "{n}" in FILE is replaced by n;  "-" means stdout,
+//                                 in which case the status lines go to stderr
+//     --emit-format binary|text   default binary
+//
+// e.g. "./planar_mt --emit sol{n}.bin 28".  The text format has one sequence per
+// line, e.g. "3 1 2 1 3 2" for n = 3.  The binary format is a 16-byte header
+//
+//     bytes 0..7     magic "PLANGFRD"
+//     bytes 8..9     format version 1, little endian
+//     byte  10       n
+//     byte  11       bits per closing position (6, or 7 when n > 32)
+//     bytes 12..15   bytes per record, little endian
+//
+// followed by one fixed-size record per solution:  the packed key described under
+// DEDUPLICATION, most significant byte first, zero-padded to a whole byte.  Records
+// come out sorted and unique.  Output goes through a large buffer straight to write(2),
+// so dumping all of PL(2, 28) is bounded by the disk, not by iostreams.
+//
+// Sorting needs every raw solution in memory (or spilled, see below).  With
+//
+//     --emit-order search
+//
+// nothing is stored instead:  the search accepts each solution only in its canonical
+// embedding (see LIBRARY), so there are no duplicates to remove, and the workers claim
+// the frontier tasks in DFS order and sort just each task's own solutions.  A task's
+// solutions are written as soon as those of every earlier task are, so the file is
+// ordered by frontier task, then by key.  The frontier is cut for about 4096 tasks
+// (or at --split-depth) whatever the number of threads, so the file is the same for
+// any thread count.  The keys cannot come out globally sorted this way, as a key lists
+// the closing positions by number, while a task fixes the positions of a prefix of
+// the sequence.  Memory holds only the solutions of the tasks finished ahead of the
+// oldest one running.  This works with the default thread workers on a static
+// frontier only, and cannot be resumed:  SIGINT or SIGTERM removes the partial file
+// and exits with status 3.
+//
+//
+// WORKER THREADS
+//
+// The search tree is cut at some depth into frontier tasks, i.e., the pending stack
+// frames at that depth, which the worker threads claim one at a time.  The depth is
+// chosen at run time:  the frames at depth 1, 2, 3, ... are counted until there are
+// at least 64 tasks per worker, so a 128-core host cuts deeper than a 16-core one.
+// "--split-depth D" fixes the depth instead.
+//
+// The tasks are claimed in order of decreasing predicted cost, so that the largest
+// subtrees start first and the run does not end with one core busy and the rest idle.
+// The prediction is a log-linear model over a few features of each task (open pairs
+// and their spans on each side, numbers still available), calibrated on a sample of
+// tasks sized with Knuth probes.  "--task-order natural" claims them in DFS order.
+//
+// "--schedule steal" skips the frontier altogether.  One worker starts at the root and
+// the others wait;  every 1024 nodes a busy worker checks whether anyone is waiting,
+// and if so hands over the bottom frame of its explicit stack, together with the open
+// masks and availability that frame expects.  The bottom frame is the shallowest
+// pending sibling, so donations start large and shrink only as the search runs dry.
+// This balances at any depth without tuning, at the price of a mutex on each donation.
+//
+// By default there is one worker per CPU this process can actually use:  the number
+// of CPUs in its affinity mask, further capped by the CFS quota of its cgroup
+// (cpu.max under cgroup v2, cpu.cfs_quota_us / cpu.cfs_period_us under v1), rounded
+// up.  In a container with a 4-CPU quota on a 64-core host that is 4 workers, not 64
+// throttled ones.  "--threads N" overrides this.
+//
+//
+// "--workers processes" runs the workers as forked processes rather than threads.  They
+// share an anonymous mmap holding the claim counters, a slot per task, and the keys;
+// a worker publishes a task's keys before marking it done, so when one is killed (by a
+// crash or the OOM killer) only its current task is lost, and the parent re-issues it
+// to a freshly forked replacement.  A task that kills three workers ends the run.
+//
+//
+// STOPPING AND RESUMING
+//
+// On SIGINT or SIGTERM, or once "--time-limit SECONDS" have passed, the workers
+// abandon their current tasks and the finished ones are saved:  a progress file (by
+// default planar_mt_n{n}.progress) listing which frontier tasks are done, and next to
+// it a .keys file with their unique solutions.  Solutions are staged per task, so an
+// abandoned task leaves nothing behind.  The process then exits with status 3, and
+//
+//     ./planar_mt --resume planar_mt_n{n}.progress 27
+//
+// continues where it stopped, at the same split depth, skipping the done tasks;  the
+// files are removed once n is solved.  n without a progress file start afresh.
+//
+//
+// RUN LOG
+//
+// "--log FILE" appends JSON lines to FILE:  one "start" event per invocation, with the
+// command line, thread count, machine, build hash, compiler and build flags (BUILD_FLAGS
+// if defined at compile time, else what the predefined macros reveal), and then one
+// "solved" (or "stopped") event per n, with the unique and raw solution counts, the
+// split depth and task count, the schedule, and the seconds spent in each phase on a
+// monotonic clock:  plan (frontier and task order), search (first worker start to last
+// worker finish), spill (sorting and writing runs under --mem-budget, which overlaps
+// the search), dedup (the final sort and scan), merge (of spilled runs) and output
+// (writing --emit).  E.g.
+//
+//     {"event":"solved","n":27,...,"seconds":{"total":329657.3,"plan":0.2,"search":...}}
+//
+// Each "solved" event is written after the result is reported and recorded, and a
+// write to the log that fails only prints a warning.
+//
+//
+// MONITORING
+//
+//     ./planar_mt --metrics /var/lib/node_exporter/textfile/planar.prom 28
+//
+// rewrites that file every 15 seconds ("--metrics-interval") in the Prometheus text
+// format, for node_exporter's textfile collector:  nodes visited and nodes per second,
+// raw solutions found, frontier tasks done and total, the fraction of the run each
+// worker has spent idle, and the resident set size, all labelled with n.  Each write
+// goes to a temporary file renamed over the old one, so a scrape never sees half.
+// The directory is checked for writing at startup;  a write that fails later, e.g. on
+// a full disk, only prints a warning, and the solve goes on.
+//
+//
+// TRACING
+//
+//     ./planar_mt --trace trace_n{n}.json 24
+//
+// records what each worker thread was doing and writes it, once n is solved, as a
+// Chrome trace for chrome://tracing or ui.perfetto.dev:  a span per task (with its
+// frontier task index under the static schedule), per wait for the results mutex
+// ("lock"), and per idle wait for work to steal ("idle");  the main thread shows
+// planning, the search and the final sort, merge and output ("finish").  A worker that
+// runs out of tasks simply stops, so the tail of the run is the empty space at the end
+// of the other rows.  Each thread keeps its last 65536 spans in a ring of its own.
+// The trace path is checked for writing at startup, and the trace is written after
+// the result is reported;  failing to write it then only prints a warning.
+//
+//
+// SWEEPS
+//
+// Solving n = 3, 4, 7, ..., 28 one after another leaves cores idle while each n runs
+// down its tail.  "--sweep lpt" plans the frontier tasks of every n first, then runs
+// them all through one pool of worker threads, the tasks predicted to be largest (of
+// any n) first, so the tails overlap with other work.  "--sweep ordered" takes the n
+// in the order given instead, which finishes the early n sooner.  Each n is counted,
+// reported and recorded as soon as its last task completes;  its reported time runs
+// from its planning to then, i.e., it includes time shared with the other n.
+//
+//
+// RESULTS REGISTRY
+//
+//     ./planar_mt --registry results.tsv
+//
+// appends one line per solved n to results.tsv:  n, count, wall milliseconds, finish
+// time, a machine fingerprint (host name, CPU model, CPU count) and a build hash, which
+// is "unknown" unless compiled with e.g. -DBUILD_HASH=\"$(git rev-parse --short HEAD)\".
+// Each new result is compared with earlier lines for the same n.  Before solving, any
+// n whose result the registry already verifies is skipped unless "--force" is given:
+// for n with a published result (the table in init_known_results) a matching line
+// suffices;  beyond that, lines from two different machines must agree, none disagreeing.
+//
+//
+// SHARDS BY THE PAIR N
+//
+// The pair n has the longest span, so where it goes constrains everything else.  It
+// opens at some position P in 0..n-2 and closes at P+n+1, drawn below or above, and
+//
+//     ./planar_mt --pair-n 5@above 28
+//
+// solves just the shard with P = 5 above:  the root task places n there up front, and
+// dfs<n> keeps its opening out of the open masks, so nothing else can close it, and
+// requires every pair opened inside it to close before P+n+1.  The 2(n-1) shards are
+// known in advance and independent, so they make natural units to hand to separate
+// machines or to check off one by one.  Each solution is counted in one shard only, as
+// --emit-order search counts it (in its canonical embedding), so the shard counts add
+// up to the total.  The left-right symmetry stays with the pair 1 (see DEDUPLICATION),
+// which keeps records canonical for "validate";  hence shards P and n-2-P differ.
+// "--pair-n all" solves every shard in turn, reporting each and then the total;  for
+// n = 16 the shards together take about as long as a plain run.  Shards are searched
+// by their own instance of dfs<n>, so plain runs pay nothing for them.
+//
+//
+// DISTRIBUTED RUNS
+//
+//     ./planar_mt --coordinator /tmp/pl.sock 28
+//     ./planar_mt --worker /tmp/pl.sock              (any number of these, any time)
+//
+// The coordinator builds the frontier and leases one task at a time to each worker
+// thread, each thread holding its own socket connection;  workers learn n and the
+// split depth from the coordinator and rebuild the identical frontier, so a lease is
+// just a task id, and the reply is the packed keys found under it.  When a connection
+// drops, e.g. because its worker process died, its lease goes back to the head of the
+// queue at once;  a lease older than "--lease-timeout" (default an hour) is re-issued
+// as well, and whichever report for a task arrives first counts.  A lost worker thus
+// costs the tasks it held, not the run.  Workers keep serving as long as the
+// coordinator has more n to solve.  The coordinator sizes the frontier for its own
+// "--threads", so give it the total thread count of all workers (or --split-depth).
+//
+//
+// PREDICTING THE RUN TIME
+//
+//     ./planar_mt --estimate 10 31
+//
+// spends about 10 seconds instead of solving:  half of it on Knuth's random probes
+// (Knuth, "Estimating the efficiency of backtrack programs", 1975) down the dfs<n>
+// tree, which give unbiased estimates of the number of search nodes and of leaves,
+// and half of it running the real search on random frontier tasks to measure nodes per
+// second on this machine with the chosen worker threads.  Their ratio is the projected
+// wall time.  The leaves are reported in two kinds:  dead ends, i.e., nodes with no
+// child to push, which are most of the tree and well estimated, and raw solutions,
+// which are so rare that for n beyond 12 or so a probe seldom or never reaches one,
+// so their estimate is noisy or missing.  The probe estimates have a heavy tail, so
+// the reported standard errors are the thing to watch;  a longer --estimate tightens
+// them.  SIGINT or SIGTERM abandons the estimate with exit status 3.
+//
+//
+// REPLAYING A TASK
+//
+// When one frontier task runs for hours, pull it out of the run to profile it:
+//
+//     perf record ./planar_mt --split-depth 9 --replay-task 1234 27
+//
+// enumerates the frontier at depth 9 in its usual order, describes task 1234 (the pairs
+// it has closed, as number@open,close, and the frame it starts from), and searches
+// just that subtree on one thread, reporting its nodes, time, nodes per second and
+// raw solutions.  Task IDs are the frontier indices shown in a --trace;  without
+// --split-depth the depth is chosen as a run with the same --threads would choose it.
+// SIGINT or SIGTERM stops the replay early:  it reports what it searched so far and
+// exits with status 3.
 //
-// If you wish all solutions sequences printed, change 'kPrint' below to 'true',
-// and recompile.
+//
+// THREAD PLACEMENT
+//
+// By default the worker threads float wherever the OS puts them.  With
+//
+//     --affinity compact     fill both SMT siblings of a core, then the next core,
+//                            then the next socket
+//     --affinity scatter     spread across sockets first, then across physical cores,
+//                            and use SMT siblings only after every core has a worker
+//     --affinity physical    use only the first SMT sibling of each physical core
+//
+// worker i is pinned to the i-th CPU of that order (modulo its length), using the
+// topology in /sys/devices/system/cpu and only the CPUs in the process' affinity mask.
+// Without --threads there are no more workers than CPUs in the order, so e.g.
+// "physical" runs one worker per physical core instead of two per core.
+// Comparing "physical" against "compact" on the same CPU count shows whether SMT
+// siblings help this branch-heavy kernel.
+//
+//
+// VALIDATING EMITTED SOLUTIONS
+//
+//     ./planar_mt validate sol28.bin
+//
+// reads a binary or text solution file and checks every record in parallel, without
+// re-running the search:  each number m must appear exactly twice with m numbers in
+// between, the pairs must admit an above/below assignment without crossings (the
+// crossing graph must be bipartite), each record must be the canonical one of its
+// left-right mirror pair (closing 1 at position <= n, as the search emits them), and
+// no record may appear twice.  The exit status is 0 only if every check passes.
+//
+//
+// LIBRARY
+//
+// planar_langford.h declares count_planar_langford(n, options) and
+// for_each_planar_langford(n, visitor, options) for programs that embed the search;
+// compile this file with -DPLANAR_LANGFORD_NO_MAIN and link it in.  They run the
+// frontier tasks on worker threads like the program does, but instead of storing raw
+// solutions and deduplicating them at the end, dfs<n> in mode kVisit remembers the
+// side of each pair and, at a leaf, accepts the solution only if it is in canonical
+// form:  the pairs that cross each other (directly or through others) form groups that
+// can each be flipped top to bottom, and the canonical form has the leftmost pair of
+// each group below.  So each unique solution is counted, and handed to the visitor on
+// the worker thread that found it, exactly once, and memory stays constant.
+//
+// PlanarLangfordGenerator turns this around for consumers that pull one solution at
+// a time:  it keeps the search suspended as a stack of pending frontier tasks, expands
+// them a level at a time down to the depth with 65536 frames, and searches one such
+// task whenever it has no solution left to hand out.  The work between two solutions
+// is thus bounded by the solutions' distance in the search order, and the memory by
+// the depth of the stack and the solutions of a single task.  Sharding skips all but
+// every num_shards-th task at that depth.
 //
 //
 // ACHIEVEMENTS
@@ -113,64 +415,599 @@
 //     https://github.com/boris-dimitrov/z4_planar_langford_multigpu
 
 
+#include "planar_langford.h"
 #include <stdlib.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/un.h>
 #include <vector>
 #include <chrono>
 #include <iostream>
 #include <algorithm>
-#include <iomanip>
 #include <array>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string>
+#include <queue>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <tuple>
+#include <iomanip>
+#include <cmath>
+#include <random>
 using namespace std;
 
-// 2^n-1 works best for the silly modulus hash thingy
-constexpr int kMaxThreads = 511;
+// Everything up to the library interface has internal linkage, so that a program can
+// link the solver in (see LIBRARY) without clashing with any of its names.  Without
+// main(), the parts of it only the command line uses are then unused, by design.
+#ifdef PLANAR_LANGFORD_NO_MAIN
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+namespace {
 
-// to avoid integer overflow, n should not exceed this constant
-constexpr int kMaxN = 31;
+// The search is cut into frontier tasks at the shallowest depth that yields at least
+// this many tasks per worker thread (see choose_split_depth<n>).
+constexpr int kTasksPerWorker = 64;
 
-// set to "true" if you want each solution printed
-constexpr bool kPrint = false;
+// to avoid integer overflow, n should not exceed this constant;
+// the open-pair masks need 2*n bits and the widest Word has 128
+constexpr int kMaxN = 63;
 
 static_assert(sizeof(int64_t) == 8, "int64_t is not 8 bytes");
 static_assert(sizeof(int32_t) == 4, "int32_t is not 4 bytes");
 static_assert(sizeof(int8_t) == 1, "int64_t is not 1 byte");
 
-constexpr int64_t lsb = 1;
-constexpr int32_t lsb32 = 1;
+typedef unsigned __int128 uint128_t;
+
+// The narrowest unsigned word with room for the 2*n bits of an open-pair mask.
+template <int n>
+using Word = typename conditional<(2 * n <= 32), uint32_t,
+             typename conditional<(2 * n <= 64), uint64_t, uint128_t>::type>::type;
+
+// The availability mask needs only n bits, so it stays 32-bit unless n > 32.
+template <typename W>
+using Avail = typename conditional<(sizeof(W) <= 8), uint32_t, uint64_t>::type;
+
+// Bit scans for each word width.  lowest_bit(x) is ffs(x), i.e., one plus the index
+// of the least significant 1-bit, or zero when x is zero.  highest_bit(x) is the index
+// of the most significant 1-bit;  x must be non-zero.
+inline int lowest_bit(uint32_t x) { return __builtin_ffs(x); }
+inline int lowest_bit(uint64_t x) { return __builtin_ffsll(x); }
+inline int lowest_bit(uint128_t x) {
+    const uint64_t lo = uint64_t(x);
+    const uint64_t hi = uint64_t(x >> 64);
+    return lo ? __builtin_ffsll(lo) : (hi ? 64 + __builtin_ffsll(hi) : 0);
+}
+
+inline int highest_bit(uint32_t x) { return 31 - __builtin_clz(x); }
+inline int highest_bit(uint64_t x) { return 63 - __builtin_clzll(x); }
+inline int highest_bit(uint128_t x) {
+    const uint64_t hi = uint64_t(x >> 64);
+    return hi ? 127 - __builtin_clzll(hi) : 63 - __builtin_clzll(uint64_t(x));
+}
+
+inline int bit_count(uint32_t x) { return __builtin_popcount(x); }
+inline int bit_count(uint64_t x) { return __builtin_popcountll(x); }
+inline int bit_count(uint128_t x) { return __builtin_popcountll(uint64_t(x)) + __builtin_popcountll(uint64_t(x >> 64)); }
 
 template <int n>
 using Positions = array<int8_t, n>;
 
+// Packed form of Positions<n>:  pos[0] occupies the top kPosBits of word 0, pos[1]
+// the next kPosBits, and so on, spilling across word boundaries as needed.  Comparing
+// keys word by word therefore orders them exactly like the positions they encode.
+template <int n>
+struct KeyLayout {
+    static constexpr int kPosBits = (2 * n <= 64) ? 6 : 7;
+    static constexpr int kWords = (n * kPosBits + 63) / 64;
+};
+
+template <int n>
+using Key = array<uint64_t, KeyLayout<n>::kWords>;
+
+template <int n>
+using Results = vector<Key<n>>;
+
+template <int n>
+Key<n> pack(const Positions<n>& pos) {
+    constexpr int bits = KeyLayout<n>::kPosBits;
+    Key<n> key;
+    key.fill(0);
+    for (int m=0;  m<n;  ++m) {
+        const uint64_t v = uint8_t(pos[m]);
+        const int w = m * bits / 64;
+        const int s = m * bits % 64;
+        if (s + bits <= 64) {
+            key[w] |= v << (64 - s - bits);
+        } else {
+            key[w] |= v >> (s + bits - 64);
+            key[w + 1] |= v << (128 - s - bits);
+        }
+    }
+    return key;
+}
+
+template <int n>
+Positions<n> unpack(const Key<n>& key) {
+    constexpr int bits = KeyLayout<n>::kPosBits;
+    constexpr uint64_t mask = (uint64_t(1) << bits) - 1;
+    Positions<n> pos;
+    for (int m=0;  m<n;  ++m) {
+        const int w = m * bits / 64;
+        const int s = m * bits % 64;
+        if (s + bits <= 64) {
+            pos[m] = (key[w] >> (64 - s - bits)) & mask;
+        } else {
+            pos[m] = ((key[w] << (s + bits - 64)) | (key[w + 1] >> (128 - s - bits))) & mask;
+        }
+    }
+    return pos;
+}
+
+// Command line options;  see usage() below.
+struct Options {
+    vector<int> ns;
+    string validate_path;
+    string emit_path;
+    bool emit_binary = true;
+    bool emit_in_search_order = false;  // stream canonical solutions task by task, unsorted
+    size_t mem_budget = 0;      // bytes;  0 means unlimited
+    string spill_dir;
+    int num_threads = 0;        // worker threads;  0 means one per CPU available to us
+    int split_depth = 0;        // depth of the frontier tasks;  0 means choose at run time
+    double estimate_seconds = 0;    // > 0 means predict the run time instead of solving
+    bool order_by_cost = true;  // claim the tasks predicted to be most expensive first
+    bool steal = false;         // split stacks on demand instead of at a fixed depth
+    string coordinator_socket;  // lease the tasks to worker processes over this socket
+    string worker_socket;       // solve tasks leased by the coordinator at this socket
+    double lease_timeout = 3600;    // seconds;  0 means leases never expire
+    bool fork = false;          // run the workers as forked processes, not threads
+    string registry_path;       // append results here, and skip n verified here
+    string sweep;               // "", "lpt" or "ordered":  solve all n on one shared pool
+    double deadline = 0;        // monotonic_seconds() at which to stop;  0 means none
+    string progress_path = "planar_mt_n{n}.progress";   // where a stopped run saves its work
+    string metrics_path;        // write Prometheus metrics here now and then
+    string log_path;            // append a JSON line per solved n here
+    string trace_path;          // write a timeline of the worker threads here
+    int64_t replay_task = -1;   // >= 0 means search only this frontier task, and report on it
+    int pair_n_open = -1;       // >= 0 means solve only the shard with the pair n opening here
+    int pair_n_side = 0;        // ... and drawn on this side, 0 below or 1 above
+    bool pair_n_all = false;    // solve every such shard in turn, counting each
+    double metrics_interval = 15;   // seconds between metrics writes
+    bool resume = false;        // continue from progress_path
+    bool force = false;         // solve n even when the registry has it verified
+    string affinity;            // "", "compact", "scatter" or "physical"
+    vector<int> affinity_cpus;  // worker i runs on affinity_cpus[i % size()], if non-empty
+};
+
+// Where the time of solving one n went, in monotonic seconds;  see RUN LOG.
+struct PhaseTimes {
+    double plan = 0;        // frontier enumeration and task ordering
+    double search = 0;      // from starting the workers until the last one is done
+    double spill = 0;       // sorting and writing spilled runs, during the search
+    double dedup = 0;       // the final sort and the scan for duplicates
+    double merge = 0;       // the k-way merge of spilled runs, emitting as it goes
+    double output = 0;      // writing and flushing the unique solutions
+    int split_depth = 0;
+    int64_t num_tasks = 0;
+    int64_t raw = 0;        // solutions before dedup
+};
+
+double monotonic_seconds();
+
+// One span of a --trace timeline, in microseconds since the solve began.
+struct TraceEvent {
+    const char* name;
+    int64_t start;
+    int64_t duration;
+    int64_t task;           // frontier task index, or -1
+};
+
+// The latest spans of one thread, for --trace;  see TRACING.  A ring is written only
+// by its own thread and read only after that thread is done, so a span costs two clock
+// reads and a store, without a lock.  When full, it overwrites its oldest spans.
+struct TraceRing {
+    static constexpr size_t kCapacity = 1 << 16;
+    vector<TraceEvent> events;  // empty when not tracing
+    size_t recorded = 0;        // spans ever recorded, of which the last kCapacity are kept
+    double origin = 0;          // monotonic seconds at time 0
+
+    void enable(double t0) {
+        events.resize(kCapacity);
+        origin = t0;
+    }
+
+    // Microseconds since origin, or 0 when not tracing.
+    int64_t now() const {
+        return events.empty() ? 0 : int64_t((monotonic_seconds() - origin) * 1e6);
+    }
+
+    // Record a span from start (a value of now()) until now.
+    void span(const char* name, int64_t start, int64_t task = -1) {
+        if (!events.empty()) {
+            events[recorded++ % kCapacity] = {name, start, now() - start, task};
+        }
+    }
+};
+
+long unixtime();
+string format_duration(double seconds);
+string expand_path(const string& pattern, int n);
+void metric_family(string& text, const string& name, const char* type, const char* help);
+void metric_sample(string& text, const string& name, const string& labels, double value);
+int64_t resident_bytes();
+bool replace_file(const string& path, const string& text);
+bool can_create(const string& path);
+bool write_trace(const string& path, const vector<TraceRing>& rings);
+bool load_solutions(const string& path, int& n, vector<int8_t>& pos, string& error);
+void pin_to_cpu(int cpu);
+void unpin_thread();
+int default_num_threads(int& cpus_allowed, int& cgroup_limit);
+int listen_unix(const string& path);
+int connect_unix(const string& path);
+bool send_all(int fd, const void* data, size_t len);
+bool recv_all(int fd, void* data, size_t len);
+
+// Print an error with the current errno and exit.
+[[noreturn]] void fatal(const string& what) {
+    cerr << "planar_mt: " << what << ": " << strerror(errno) << "\n";
+    exit(2);
+}
+
+// Print a warning with the current errno, and carry on.
+void warn(const string& what) {
+    cerr << "planar_mt: warning: " << what << ": " << strerror(errno) << "\n";
+}
+
+// Set by SIGINT, SIGTERM or --time-limit;  workers abandon their tasks and solve<n>
+// saves its progress.  See STOPPING AND RESUMING at the top of this file.
+atomic<bool> stop_requested(false);
+
+// Exit status of a run stopped early, e.g. with its progress saved.
+constexpr int kExitStopped = 3;
+
+// Pins the calling thread to the CPU of worker i in the --affinity order, if there is
+// one, for as long as it lives.  run_on_threads runs worker 0 on the calling thread,
+// which must not stay pinned afterwards, or the final sort would run on one CPU.
+class CpuPin {
+  public:
+    CpuPin(const Options& options, int i) : pinned(!options.affinity_cpus.empty()) {
+        if (pinned) {
+            pin_to_cpu(options.affinity_cpus[i % options.affinity_cpus.size()]);
+        }
+    }
+
+    ~CpuPin() {
+        if (pinned) {
+            unpin_thread();
+        }
+    }
+
+  private:
+    bool pinned;
+};
+
+// Rebuild the sequence s[0..2n-1] from the closing positions.
 template <int n>
-using Results = vector<Positions<n>>;
+void to_sequence(const Positions<n>& pos, int (&s)[2 * n]) {
+    for (int i=0; i<2*n; ++i) {
+        s[i] = -1;
+    }
+    for (int m=1;  m<=n;  ++m) {
+        int k2 = pos[m-1];
+        int k1 = k2 - m - 1;
+        assert(0 <= k1);
+        assert(k2 < 2*n);
+        assert(s[k1] == -1);
+        assert(s[k2] == -1);
+        s[k1] = s[k2] = m;
+    }
+}
+
+// Buffered writer for emitted solutions, in the binary or text format described at
+// the top of this file.  Records accumulate in a large buffer that is handed to
+// write(2) whenever it fills up, and once more on destruction.
+class SolutionWriter {
+  public:
+    static constexpr size_t kBufferSize = 1 << 23;
+
+    SolutionWriter(const string& path, int n, int pos_bits, bool binary)
+        : path(path), binary(binary), record_bytes((n * pos_bits + 7) / 8), used(0), count(0) {
+        fd = (path == "-") ? 1 : open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            fatal("cannot create " + path);
+        }
+        buffer.resize(kBufferSize);
+        if (binary) {
+            memcpy(&buffer[0], "PLANGFRD", 8);
+            buffer[8] = 1;
+            buffer[9] = 0;
+            buffer[10] = char(n);
+            buffer[11] = char(pos_bits);
+            for (int i=0;  i<4;  ++i) {
+                buffer[12 + i] = char(record_bytes >> (8 * i));
+            }
+            used = 16;
+        }
+    }
+
+    ~SolutionWriter() {
+        flush();
+        if (fd != 1) {
+            close(fd);
+        }
+    }
+
+    template <int n>
+    void write(const Key<n>& key) {
+        if (used + 6 * n > buffer.size()) {
+            flush();
+        }
+        char* out = &buffer[used];
+        if (binary) {
+            for (int j=0;  j<record_bytes;  ++j) {
+                out[j] = char(key[j / 8] >> (56 - 8 * (j % 8)));
+            }
+            out += record_bytes;
+        } else {
+            int s[2 * n];
+            to_sequence<n>(unpack<n>(key), s);
+            for (int i=0;  i<2*n;  ++i) {
+                if (s[i] >= 10) {
+                    *out++ = char('0' + s[i] / 10);
+                }
+                *out++ = char('0' + s[i] % 10);
+                *out++ = (i + 1 < 2 * n) ? ' ' : '\n';
+            }
+        }
+        used = out - &buffer[0];
+        ++count;
+    }
+
+    int64_t written() const {
+        return count;
+    }
+
+    const string path;
+
+  private:
+    void flush() {
+        const char* p = &buffer[0];
+        while (used) {
+            const ssize_t w = ::write(fd, p, used);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fatal("cannot write " + path);
+            }
+            p += w;
+            used -= w;
+        }
+    }
+
+    const bool binary;
+    const int record_bytes;
+    int fd;
+    vector<char> buffer;
+    size_t used;
+    int64_t count;
+};
 
 template <int n>
-void print(const Positions<n>& pos);
+class ResultStore;
+
+// A frontier task is one pending stack frame (k, m, d, num_open) of dfs<n> together
+// with the state it expects to find when popped:  the open masks and availability
+// after positions 0..k-1 have been filled, and the closing positions placed so far.
+// The root task is the first frame of the whole search.
+template <int n, typename W = Word<n>>
+struct Task {
+    int8_t k, m, d, num_open;
+    W open[2];
+    Avail<W> avail;
+    Positions<n> pos;
+    W sides;        // bit i set if the pair at position i < k is drawn above;  kFrontier, kVisit
+    // the shard (--pair-n):  the pair n opens at fix_open and is drawn on side fix_side
+    // (0 below, 1 above);  fix_open = -1 means no shard
+    int8_t fix_open, fix_side;
+
+    static Task root(int fix_open = -1, int fix_side = 0) {
+        constexpr Avail<W> msb = Avail<W>(1) << (n - 1);
+        Task task;
+        task.fix_open = fix_open;
+        task.fix_side = fix_side;
+        // every solution starts out by opening a below-pair at position 0
+        task.k = 0;
+        task.m = -1;
+        task.d = 0;
+        task.num_open = 0;
+        task.open[0] = task.open[1] = 0;
+        task.sides = 0;
+        // initially none of the numbers 1, 2, ..., n have been placed;
+        // this is represented by setting bits 0..n-1 to 1 in avail
+        task.avail = msb | (msb - 1);
+        task.pos.fill(0);
+        if (fix_open >= 0) {
+            // a shard places n up front;  see dfs
+            task.avail ^= msb;
+            task.pos[n - 1] = fix_open + n + 1;
+        }
+        return task;
+    }
+};
 
+// Messages between --coordinator and --worker processes, in host byte order.  Each
+// worker connection receives a Hello, then alternates between sending a Report and
+// receiving a Lease.  The first Report on a connection names no task;  each later
+// one carries the keys found under the task leased just before it.
+struct Hello {
+    char magic[8];          // "PLANGFRC"
+    int32_t n;
+    int32_t split_depth;    // the worker rebuilds the same frontier from n and this
+    uint32_t num_tasks;
+    uint32_t more;          // non-zero if the coordinator will serve another n after this one
+};
+
+struct Report {
+    uint32_t task;
+    uint32_t num_keys;      // followed by num_keys packed keys
+    int64_t nodes;
+};
+
+struct Lease {
+    uint32_t task;          // kNoTask once every task is done
+};
+
+constexpr uint32_t kNoTask = 0xffffffff;
+
+// Whether the pairs of a solution, each drawn on the side given by side[] at its
+// closing position, form the canonical one of its top-bottom twins:  the pairs fall
+// into groups that cross each other directly or through other pairs, each group can
+// be flipped as a whole, and the canonical embedding has the leftmost pair of every
+// group below.  The search finds every embedding with the pair at position 0 below,
+// so exactly one of them passes.  Only called at leaves, so its O(n^2) cost is small.
 template <int n>
-void dfs(Results<n>& results, const int num_threads, const int thread_id, mutex& mtx) {
+bool canonical_sides(const Positions<n>& pos, const int8_t* side) {
+    // group[m]:  union-find parent of pair m+1;  the root of each group is its leftmost pair
+    int group[n];
+    for (int m=0;  m<n;  ++m) {
+        group[m] = m;
+    }
+    auto find = [&group](int m) {
+        while (group[m] != m) {
+            m = group[m] = group[group[m]];
+        }
+        return m;
+    };
+    for (int i=0;  i<n;  ++i) {
+        const int open_i = pos[i] - i - 2;
+        for (int j=0;  j<n;  ++j) {
+            const int open_j = pos[j] - j - 2;
+            if (open_i < open_j && open_j < pos[i] && pos[i] < pos[j]) {
+                const int a = find(i), b = find(j);
+                if (a != b) {
+                    // keep the leftmost pair as the root
+                    if (pos[a] - a < pos[b] - b) {
+                        group[b] = a;
+                    } else {
+                        group[a] = b;
+                    }
+                }
+            }
+        }
+    }
+    for (int m=0;  m<n;  ++m) {
+        if (group[m] == m && side[pos[m]]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// What a call to dfs<n, W, mode> does with the subtree below its task.
+enum Mode {
+    kSearch,        // add every solution to results
+    kFrontier,      // collect (or just count) the frames at depth split_depth
+    kProbe,         // follow one random path, Knuth style, accumulating estimates
+    kBounded,       // search like kSearch, but stop after node_budget nodes and keep nothing
+    kSteal,         // search like kSearch, donating stack frames to idle workers in pool
+    kVisit,         // count, and pass to visitor, each solution in its canonical embedding
+};
+
+// Shared state of the work-stealing scheduler (--schedule steal).  Idle workers wait
+// on cv for tasks;  a busy worker that sees hungry > 0 donates the bottom frame of its
+// stack, i.e. its shallowest pending sibling, which usually has the largest subtree.
+template <int n, typename W>
+struct StealPool {
+    mutex mtx;
+    condition_variable cv;
+    vector<Task<n, W>> tasks;   // donated, not yet claimed
+    int busy = 0;               // workers inside dfs
+    atomic<int> hungry{0};      // workers waiting for a task;  read without mtx by donors
+    int64_t donations = 0;
+};
+
+// Inputs and outputs of dfs<n, W, mode>;  each mode uses only its own fields.
+template <int n, typename W>
+struct Search {
+    ResultStore<n>* results = nullptr;          // kSearch
+    mutex* mtx = nullptr;                       // kSearch
+    vector<Key<n>>* keys = nullptr;             // kSearch:  if set, collect here instead
+    const atomic<bool>* stop = nullptr;         // kSearch, kVisit:  if set, abandon the task once true
+    atomic<int64_t>* live_nodes = nullptr;      // kSearch, kSteal:  if set, nodes so far, now and then
+    bool abandoned = false;                     // kSearch, kVisit:  stop was seen
+    StealPool<n, W>* pool = nullptr;            // kSteal
+    int split_depth = 0;                        // kFrontier
+    vector<Task<n, W>>* frontier = nullptr;     // kFrontier;  null to only count
+    int64_t num_frontier = 0;                   // kFrontier
+    mt19937_64* rng = nullptr;                  // kProbe
+    double est_nodes = 0;                       // kProbe:  Knuth estimates of this probe
+    double est_leaves = 0;                      // kProbe:  raw solutions
+    double est_dead_ends = 0;                   // kProbe:  nodes without children
+    int64_t node_budget = 0;                    // kBounded
+    const PlanarLangfordVisitor* visitor = nullptr; // kVisit;  null to only count
+    vector<Positions<n>>* found = nullptr;      // kVisit:  if set, collect here instead
+    int64_t visited = 0;                        // kVisit:  unique solutions found
+    int64_t nodes = 0;                          // all modes:  frames placed
+};
+
+// Search the subtree below one task;  see Mode.
+template <int n, typename W, Mode mode, bool fixed = false>
+void dfs(const Task<n, W>& task, Search<n, W>& search) {
+    static_assert(2 * n <= 8 * sizeof(W), "W is too narrow for n");
+    // shards get their own instance, so that the rest pay nothing for them
+    if (!fixed && task.fix_open >= 0) {
+        dfs<n, W, mode, true>(task, search);
+        return;
+    }
+    typedef Avail<W> A;
     constexpr int two_n = 2 * n;
-    constexpr int two_n_less_1 = 2 * n - 1;
-    constexpr int64_t msb = lsb << (int64_t)(n - 1);
-    constexpr int64_t nn1 = lsb << (two_n - 1);
-    // initially none of the numbers 1, 2, ..., n have been placed;
-    // this is represented by setting bits 0..n-1 to 1 in avail
-    int32_t availability[2 * n + 1];
-    availability[0] = msb | (msb - 1);
+    constexpr W nn1 = W(1) << (two_n - 1);
+    // availability[k] has bit m set if m+1 is still available after positions 0..k-1
+    A availability[2 * n + 1];
+    availability[task.k] = task.avail;
     // let pos[m] be the position of the closing m+1, for each m
-    Positions<n> pos;
+    Positions<n> pos = task.pos;
     // open[2*k+2] represents the nested open-from-above pairs in positions 0...k
     // open[2*k+3] is same for below
-    int64_t open[4*n + 2];
-    open[0] = 0;
-    open[1] = 0;
+    W open[4*n + 2];
+    open[2 * task.k] = task.open[0];
+    open[2 * task.k + 1] = task.open[1];
     int8_t k, m, d, num_open;
+    int64_t nodes = 0;
+    double weight = 1;
+    // A shard (--pair-n, fixed) places n at fix_open and fix_close on fix_side up front:  n is
+    // not in avail, so nothing else can close as n, and the opening at fix_open stays
+    // out of the open masks, so nothing else can close it either.  It must find no
+    // pair open on its side, as any such pair would need to be longer than n, and at
+    // fix_close every pair opened inside it must be closed.
+    const int fix_open = task.fix_open;
+    const int fix_close = task.fix_open + n + 1;
+    const int fix_side = task.fix_side;
+    // kFrontier, kVisit:  side[k] is the side (0 below, 1 above) of the pair at position k
+    int8_t side[2 * n];
+    if (mode == kFrontier || mode == kVisit) {
+        for (int i=0;  i<task.k;  ++i) {
+            side[i] = (task.sides >> i) & 1;
+        }
+    }
     // there are 2*n positions with 3 decisions per position and 4 bytes per decision on the stack
     int8_t stack[24 * n];
-    // the size of the arrays above add up to ~2KB for n=32
+    // the size of the arrays above add up to ~2KB for n=32 (~4KB for n=63)
     // this bodes well for fitting tousands of threads inside on-chip memory
     int top = 0;
     // lambdas look better but... macros still outperform them
@@ -186,222 +1023,3280 @@ void dfs(Results<n>& results, const int num_threads, const int thread_id, mutex&
         m = stack[--top]; \
         k = stack[--top]; \
     } while (0)
-    // every solution starts out by opening a below-pair at position 0
-    push(0, -1, 0, 0);
+    push(task.k, task.m, task.d, task.num_open);
     while (top) {
+        if (mode == kBounded && nodes == search.node_budget) {
+            break;
+        }
+        if ((mode == kSearch || mode == kSteal || mode == kVisit) && (nodes & 1023) == 0) {
+            if (search.live_nodes) {
+                search.live_nodes->store(search.nodes + nodes, memory_order_relaxed);
+            }
+            if ((mode == kSearch || mode == kVisit) && search.stop && search.stop->load(memory_order_relaxed)) {
+                search.abandoned = true;
+                break;
+            }
+        }
+        // Every 1024 nodes, give the bottom frame away if a worker is idle.  Frames
+        // on the stack have nondecreasing k, so open[2*k], open[2*k+1], availability[k]
+        // of the bottom frame are still those its parent left behind.  Entries of pos
+        // past depth k are stale, but will be overwritten before the next leaf.
+        if (mode == kSteal && (nodes & 1023) == 0 && top > 4 &&
+                search.pool->hungry.load(memory_order_relaxed)) {
+            StealPool<n, W>& pool = *search.pool;
+            lock_guard<mutex> lock(pool.mtx);
+            if (pool.hungry > (int) pool.tasks.size()) {
+                Task<n, W> t;
+                t.k = stack[0];
+                t.m = stack[1];
+                t.d = stack[2];
+                t.num_open = stack[3];
+                t.open[0] = open[2 * t.k];
+                t.open[1] = open[2 * t.k + 1];
+                t.avail = availability[t.k];
+                t.pos = pos;
+                t.sides = 0;
+                t.fix_open = task.fix_open;
+                t.fix_side = task.fix_side;
+                pool.tasks.push_back(t);
+                ++pool.donations;
+                top -= 4;
+                memmove(stack, stack + 4, top);
+                pool.cv.notify_one();
+            }
+        }
         pop(k, m, d, num_open);
-        int64_t* openings = open + 2 * k + 2;
+        if (fixed && k == fix_open && (m >= 0 || d != fix_side || open[2 * k + fix_side])) {
+            continue;
+        }
+        if (mode == kFrontier && k == search.split_depth) {
+            if (search.frontier) {
+                Task<n, W> t;
+                t.k = k;
+                t.m = m;
+                t.d = d;
+                t.num_open = num_open;
+                t.open[0] = open[2 * k];
+                t.open[1] = open[2 * k + 1];
+                t.avail = availability[k];
+                t.pos = pos;
+                t.fix_open = task.fix_open;
+                t.fix_side = task.fix_side;
+                t.sides = 0;
+                for (int i=0;  i<k;  ++i) {
+                    t.sides |= W(side[i]) << i;
+                }
+                search.frontier->push_back(t);
+            }
+            ++search.num_frontier;
+            continue;
+        }
+        ++nodes;
+        if (mode == kProbe) {
+            search.est_nodes += weight;
+        }
+        W* openings = open + 2 * k + 2;
         openings[0] = openings[-2];
         openings[1] = openings[-1];
-        int32_t avail = availability[k];
+        A avail = availability[k];
         // On CPU, this macro trick improves perf over 10% by letting the compiler
         // take advantage of the fact that d can only be 0 or 1.
         // Makes no difference on GPU.
         #define place_macro(d) do { \
             if (m>=0) { \
                 pos[m] = k; \
-                avail ^= (lsb32 << m); \
+                avail ^= (A(1) << m); \
                 openings[d] &= (openings[d] - 1); \
             } else { \
                 openings[d] |= nn1 >> k; \
                 ++num_open; \
             } \
         } while (0)
-        if (d) {
+        if (fixed && (k == fix_open || k == fix_close)) {
+            num_open += (k == fix_open);
+        } else if (d) {
             place_macro(1);
         } else {
             place_macro(0);
         }
+        if (mode == kFrontier || mode == kVisit) {
+            side[k] = d;
+        }
         ++k;
         availability[k] = avail;
         if (k == two_n) {
-            mtx.lock();
-            results.push_back(pos);
-            mtx.unlock();
+            if (mode == kSearch || mode == kSteal) {
+                const Key<n> key = pack<n>(pos);
+                if (search.keys) {
+                    search.keys->push_back(key);
+                } else {
+                    search.mtx->lock();
+                    search.results->add(key);
+                    search.mtx->unlock();
+                }
+            } else if (mode == kProbe) {
+                search.est_leaves += weight;
+            } else if (mode == kVisit && canonical_sides<n>(pos, side)) {
+                ++search.visited;
+                if (search.found) {
+                    search.found->push_back(pos);
+                } else if (search.visitor) {
+                    int s[2 * n];
+                    to_sequence<n>(pos, s);
+                    (*search.visitor)(s, 2 * n);
+                }
+            }
         } else {
-            // A super-naive way to divide the work across threads.  A hash of the current state at k_limit
-            // determines whether the current thread should be pursuing a completion from this state or not.
-            // The depth k_limit is chosen empirically to be both shallow enough so it's quick to reach and
-            // deep enough to allow plenty of concurrency. This seems to work remarkably well in practice.
-            constexpr int8_t k_limit = (n > 19 ? (8 + (n / 3)) : (n - 5));
-            if (kMaxThreads > 1 &&
-                k == k_limit &&
-                // multiply by a nice Mersenne prime to divide the work evenly across the threads... it works well...
-                uint64_t(131071 * (openings[1] - openings[0]) + avail) % kMaxThreads != thread_id) {
-                // some other thread will work on this
-                continue;
+            // Dead-opening cutoff.  The oldest open pair is the highest set bit of the
+            // combined open masks;  m_needed is the (0-based) number it would take if
+            // closed right now, and it can only grow from here.
+            const W all_open = openings[0] | openings[1];
+            if (all_open) {
+                const int m_needed = k - two_n - 1 + highest_bit(all_open);
+                const int m_max = highest_bit(avail);
+                if (m_max < m_needed) {
+                    if (mode == kProbe) {
+                        search.est_dead_ends += weight;
+                    }
+                    continue;
+                }
             }
             // Now push on the stack the the children of the current node in the search tree.
-            int8_t offset = k - two_n - 2;
-            for (d=0; d<2; ++d) {
-                if (openings[d]) { // if there is an opening, try closing it
-                    // let m be the distance to the opening, less 1
-                    m = offset + __builtin_ffsll(openings[d]);
-                    // m could be -1 when the opening was at k-1
-                    // only m from 0..n-1 are worth pursuing
-                    if (((unsigned)m < n) && ((avail >> m) & 1)) {
-                        if (m || k <= n) { // this dedups L <==> R reversal twins
-                            push(k, m, d, num_open);
+            if (fixed && k == fix_close) {
+                if (!openings[fix_side]) {
+                    push(k, n - 1, fix_side, num_open);
+                }
+            } else {
+                int8_t offset = k - two_n - 2;
+                for (d=0; d<2; ++d) {
+                    if (openings[d]) { // if there is an opening, try closing it
+                        // let m be the distance to the opening, less 1
+                        m = offset + lowest_bit(openings[d]);
+                        // m could be -1 when the opening was at k-1
+                        // only m from 0..n-1 are worth pursuing
+                        if (((unsigned)m < n) && ((avail >> m) & 1)) {
+                            if (m || k <= n) { // this dedups L <==> R reversal twins
+                                push(k, m, d, num_open);
+                            }
                         }
                     }
                 }
+                if (num_open < n) {
+                    push(k, -1, 1, num_open);
+                    push(k, -1, 0, num_open);
+                }
+            }
+            if (mode == kProbe && top) {
+                // the stack was empty before the children were pushed;  keep one at random
+                const int children = top / 4;
+                const int r = (*search.rng)() % children;
+                for (int i=0;  i<4;  ++i) {
+                    stack[i] = stack[4 * r + i];
+                }
+                top = 4;
+                weight *= children;
+            } else if (mode == kProbe) {
+                search.est_dead_ends += weight;
+            }
+        }
+    }
+    #undef place_macro
+    #undef pop
+    #undef push
+    search.nodes += nodes;
+}
+
+// Pick the depth at which to cut the search into frontier tasks:  the shallowest
+// one with at least target frames, found by counting the frames at depth 1, 2, ...
+// in turn.  Each probe costs about as much as enumerating the frontier itself, and
+// the frontier grows geometrically with depth, so all probes together cost little.
+// If no depth reaches target (tiny n), the depth with the most frames wins.
+template <int n, typename W>
+int choose_split_depth(int64_t target, const Task<n, W>& root = Task<n, W>::root()) {
+    int best_depth = 1;
+    int64_t best_count = 0;
+    for (int depth = 1;  depth < 2 * n;  ++depth) {
+        Search<n, W> search;
+        search.split_depth = depth;
+        dfs<n, W, kFrontier>(root, search);
+        const int64_t count = search.num_frontier;
+        if (count > best_count) {
+            best_depth = depth;
+            best_count = count;
+        }
+        if (count >= target) {
+            break;
+        }
+    }
+    return best_depth;
+}
+
+// Run f(0), f(1), ..., f(num_threads - 1) concurrently and wait for all of them.
+template <typename F>
+void run_on_threads(int num_threads, const F& f) {
+    vector<thread> threads;
+    for (int t=1;  t<num_threads;  ++t) {
+        threads.emplace_back(f, t);
+    }
+    f(0);
+    for (auto& th : threads) {
+        th.join();
+    }
+}
+
+// Parallel LSD radix sort of fixed-width keys, one byte per pass, starting from the
+// least significant byte of the last word.  Each thread histograms and then scatters
+// its own contiguous chunk, which keeps every pass stable.  Passes in which all keys
+// share the same byte (e.g. the unused tail of the last word) are skipped.
+template <typename K>
+void radix_sort(vector<K>& keys) {
+    constexpr int kWords = tuple_size<K>::value;
+    const size_t size = keys.size();
+    if (size < 2) {
+        return;
+    }
+    int cpus_allowed, cgroup_limit;
+    const int num_threads = (int) min<size_t>(default_num_threads(cpus_allowed, cgroup_limit), 1 + size / 65536);
+    auto chunk_begin = [&](int t) { return size * t / num_threads; };
+    vector<K> buffer(size);
+    vector<array<size_t, 256>> counts(num_threads);
+    for (int w = kWords - 1;  w >= 0;  --w) {
+        for (int shift = 0;  shift < 64;  shift += 8) {
+            run_on_threads(num_threads, [&](int t) {
+                auto& c = counts[t];
+                c.fill(0);
+                for (size_t i = chunk_begin(t);  i < chunk_begin(t + 1);  ++i) {
+                    ++c[(keys[i][w] >> shift) & 255];
+                }
+            });
+            size_t offset = 0;
+            bool trivial = false;
+            for (int b=0;  b<256;  ++b) {
+                size_t bucket_size = 0;
+                for (int t=0;  t<num_threads;  ++t) {
+                    const size_t c = counts[t][b];
+                    counts[t][b] = offset;
+                    offset += c;
+                    bucket_size += c;
+                }
+                trivial |= (bucket_size == size);
             }
-            if (num_open < n) {
-                push(k, -1, 1, num_open);
-                push(k, -1, 0, num_open);
+            if (trivial) {
+                continue;
             }
+            run_on_threads(num_threads, [&](int t) {
+                auto& c = counts[t];
+                for (size_t i = chunk_begin(t);  i < chunk_begin(t + 1);  ++i) {
+                    buffer[c[(keys[i][w] >> shift) & 255]++] = keys[i];
+                }
+            });
+            keys.swap(buffer);
         }
     }
 }
 
 // Sort the vector of solution sequences and count the unique ones.
-// Optionally print each unique one.
+// Optionally emit each unique one.
 template <int n>
-int64_t unique_count(Results<n> &results) {
+int64_t unique_count(Results<n> &results, SolutionWriter* writer, PhaseTimes* times = nullptr) {
     int64_t total = results.size();
     int64_t unique = total;
-    sort(results.begin(), results.end());
-    if (kPrint && total) {
-        print<n>(results[0]);
+    const double t_sort = monotonic_seconds();
+    radix_sort(results);
+    const double t_scan = monotonic_seconds();
+    if (times) {
+        times->dedup += t_scan - t_sort;
     }
-    for (int i=1; i<total; ++i) {
+    if (writer && total) {
+        writer->write<n>(results[0]);
+    }
+    for (int64_t i=1; i<total; ++i) {
         if (results[i] == results[i-1]) {
             --unique;
-        } else if (kPrint) {
-            print<n>(results[i]);
+        } else if (writer) {
+            writer->write<n>(results[i]);
         }
     }
+    if (times) {
+        (writer ? times->output : times->dedup) += monotonic_seconds() - t_scan;
+    }
     return unique;
 }
 
-// This is the main function of the sequential algorithm.
+// Raw solutions as they come out of the search.  Without a memory budget this is just
+// a vector.  With one, the vector is sorted, deduplicated and spilled to a temporary
+// run file whenever it reaches its capacity, and finish() merges the runs.  The
+// capacity leaves room for the radix sort's scratch copy within the budget.
 template <int n>
-int solve() {
-    if (n <= 0 || n > kMaxN || n % 4 == 1 || n % 4 == 2) {
-        return 0;
+class ResultStore {
+  public:
+    explicit ResultStore(const Options& options)
+        : capacity(options.mem_budget / (2 * sizeof(Key<n>))), spill_dir(options.spill_dir), spilled(0),
+          added(0), spill_seconds(0) {
+        if (options.mem_budget) {
+            capacity = max<size_t>(capacity, 1);
+            keys.reserve(capacity);
+        }
+        if (spill_dir.empty()) {
+            const char* tmpdir = getenv("TMPDIR");
+            spill_dir = tmpdir ? tmpdir : "/tmp";
+        }
     }
-    Results<n> results;
-    int num_running = kMaxThreads;
-    mutex mtx;
-    for (int thread_id=0;  thread_id < kMaxThreads;  ++thread_id) {
-        auto thread_func = [&](int thread_id) {
-            dfs<n>(results, kMaxThreads, thread_id, mtx);
-            mtx.lock();
-            --num_running;
-            mtx.unlock();
-        };
-        thread(thread_func, thread_id).detach();
+
+    ~ResultStore() {
+        for (int fd : runs) {
+            close(fd);
+        }
     }
-    bool done = false;
-    while (!done) {
-        this_thread::sleep_for(chrono::milliseconds(50));
+
+    // The caller serializes calls to add().
+    void add(const Key<n>& key) {
+        ++added;
+        keys.push_back(key);
+        if (keys.size() == capacity) {
+            spill();
+        }
+    }
+
+    // Count the unique solutions, emitting each one if writer is non-null, and
+    // account for the time taken in times, if non-null.
+    int64_t finish(SolutionWriter* writer, PhaseTimes* times = nullptr) {
+        if (runs.empty()) {
+            if (times) {
+                times->raw = added;
+            }
+            return unique_count<n>(keys, writer, times);
+        }
+        const double t_spill = monotonic_seconds();
+        spill();
+        const double t_merge = monotonic_seconds();
+        const int64_t unique = merge(writer);
+        if (times) {
+            times->raw = added;
+            times->spill += spill_seconds - (t_merge - t_spill);
+            times->dedup += t_merge - t_spill;
+            times->merge += monotonic_seconds() - t_merge;
+        }
+        return unique;
+    }
+
+    int num_runs() const {
+        return runs.size();
+    }
+
+    int64_t num_spilled() const {
+        return spilled;
+    }
+
+  private:
+    // Sort and dedup the buffer, append it to a fresh unlinked temp file, and empty it.
+    void spill() {
+        const double t_start = monotonic_seconds();
+        radix_sort(keys);
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+        string path = spill_dir + "/planar_mt.XXXXXX";
+        const int fd = mkstemp(&path[0]);
+        if (fd < 0) {
+            fatal("cannot create a spill file in " + spill_dir);
+        }
+        unlink(path.c_str());
+        const char* p = reinterpret_cast<const char*>(keys.data());
+        size_t left = keys.size() * sizeof(Key<n>);
+        while (left) {
+            const ssize_t w = write(fd, p, left);
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fatal("cannot write a spill file in " + spill_dir);
+            }
+            p += w;
+            left -= w;
+        }
+        runs.push_back(fd);
+        spilled += keys.size();
+        keys.clear();
+        spill_seconds += monotonic_seconds() - t_start;
+    }
+
+    // Sequential reader over one sorted run.
+    struct RunReader {
+        int fd;
+        off_t offset;
+        vector<Key<n>> buffer;
+        size_t next;
+        size_t end;
+
+        bool read(Key<n>& key) {
+            if (next == end) {
+                ssize_t r;
+                do {
+                    r = pread(fd, buffer.data(), buffer.size() * sizeof(Key<n>), offset);
+                } while (r < 0 && errno == EINTR);
+                if (r < 0) {
+                    fatal("cannot read a spill file");
+                }
+                offset += r;
+                next = 0;
+                end = r / sizeof(Key<n>);
+                if (!end) {
+                    return false;
+                }
+            }
+            key = buffer[next++];
+            return true;
+        }
+    };
+
+    // Streaming k-way merge of all runs, counting (and emitting) each key once.
+    int64_t merge(SolutionWriter* writer) {
+        keys.clear();
+        keys.shrink_to_fit();
+        const size_t per_run = max<size_t>(4096, capacity / runs.size());
+        vector<RunReader> readers(runs.size());
+        typedef pair<Key<n>, int> Head;
+        priority_queue<Head, vector<Head>, greater<Head>> heads;
+        for (size_t r=0;  r<runs.size();  ++r) {
+            readers[r].fd = runs[r];
+            readers[r].offset = 0;
+            readers[r].buffer.resize(per_run);
+            readers[r].next = readers[r].end = 0;
+            Key<n> key;
+            if (readers[r].read(key)) {
+                heads.push(Head(key, r));
+            }
+        }
+        int64_t unique = 0;
+        Key<n> last;
+        while (!heads.empty()) {
+            Head head = heads.top();
+            heads.pop();
+            if (!unique || head.first != last) {
+                last = head.first;
+                ++unique;
+                if (writer) {
+                    writer->write<n>(last);
+                }
+            }
+            if (readers[head.second].read(head.first)) {
+                heads.push(head);
+            }
+        }
+        return unique;
+    }
+
+    Results<n> keys;
+    size_t capacity;
+    string spill_dir;
+    vector<int> runs;
+    int64_t spilled;
+    int64_t added;
+    double spill_seconds;
+};
+
+// Predict the size of the search and its wall time on this machine;  see PREDICTING
+// THE RUN TIME at the top of this file.
+template <int n, typename W = Word<n>>
+void estimate(const Options& options) {
+    using namespace chrono;
+    const int num_threads = options.num_threads;
+    const auto half = duration<double>(options.estimate_seconds / 2);
+    // Knuth probes, each thread with its own generator and running sums
+    struct Sums {
+        int64_t probes = 0;
+        double nodes = 0, nodes_sq = 0, dead_ends = 0, dead_ends_sq = 0, leaves = 0, leaves_sq = 0;
+    };
+    vector<Sums> sums(num_threads);
+    const Task<n, W> root = Task<n, W>::root(options.pair_n_open, options.pair_n_side);
+    const uint64_t seed = random_device()() ^ uint64_t(unixtime());
+    auto deadline = steady_clock::now() + half;
+    run_on_threads(num_threads, [&](int t) {
+        mt19937_64 rng(seed + t);
+        Sums& sum = sums[t];
+        do {
+            for (int i=0;  i<256;  ++i) {
+                Search<n, W> search;
+                search.rng = &rng;
+                dfs<n, W, kProbe>(root, search);
+                ++sum.probes;
+                sum.nodes += search.est_nodes;
+                sum.nodes_sq += search.est_nodes * search.est_nodes;
+                sum.dead_ends += search.est_dead_ends;
+                sum.dead_ends_sq += search.est_dead_ends * search.est_dead_ends;
+                sum.leaves += search.est_leaves;
+                sum.leaves_sq += search.est_leaves * search.est_leaves;
+            }
+        } while (steady_clock::now() < deadline && !stop_requested);
+    });
+    if (stop_requested) {
+        cout << unixtime() << " Stopped the estimate for n = " << n << "\n";
+        exit(kExitStopped);
+    }
+    Sums total;
+    for (const Sums& sum : sums) {
+        total.probes += sum.probes;
+        total.nodes += sum.nodes;
+        total.nodes_sq += sum.nodes_sq;
+        total.dead_ends += sum.dead_ends;
+        total.dead_ends_sq += sum.dead_ends_sq;
+        total.leaves += sum.leaves;
+        total.leaves_sq += sum.leaves_sq;
+    }
+    const double p = total.probes;
+    const double nodes = total.nodes / p;
+    const double dead_ends = total.dead_ends / p;
+    const double leaves = total.leaves / p;
+    // relative standard error of the mean, in percent
+    auto rse = [p](double mean, double sum_sq) {
+        return mean > 0 ? 100 * sqrt(max(0.0, sum_sq / p - mean * mean) / p) / mean : 0.0;
+    };
+    // nodes per second:  bounded real searches from random tasks of a fine frontier
+    vector<Task<n, W>> tasks;
+    Search<n, W> enumeration;
+    enumeration.split_depth = choose_split_depth<n, W>(4096, root);
+    enumeration.frontier = &tasks;
+    dfs<n, W, kFrontier>(root, enumeration);
+    if (tasks.empty()) {
+        // only a --pair-n shard can be this small
+        cout << unixtime() << " Estimate for n = " << n << ":  the shard is empty\n";
+        return;
+    }
+    vector<int64_t> searched(num_threads, 0);
+    const auto t_start = steady_clock::now();
+    deadline = t_start + half;
+    run_on_threads(num_threads, [&](int t) {
+        mt19937_64 rng(seed ^ (t + 1));
+        do {
+            Search<n, W> search;
+            search.node_budget = 1 << 20;
+            dfs<n, W, kBounded>(tasks[rng() % tasks.size()], search);
+            searched[t] += search.nodes;
+        } while (steady_clock::now() < deadline && !stop_requested);
+    });
+    if (stop_requested) {
+        cout << unixtime() << " Stopped the estimate for n = " << n << "\n";
+        exit(kExitStopped);
+    }
+    const double elapsed = duration<double>(steady_clock::now() - t_start).count();
+    double rate = 0;
+    for (int64_t s : searched) {
+        rate += s / elapsed;
+    }
+    cout << unixtime() << " Estimate for n = " << n << " from " << total.probes << " probes:  "
+         << scientific << setprecision(3) << nodes << " search nodes (+-" << fixed << setprecision(1)
+         << rse(nodes, total.nodes_sq) << "%), " << scientific << setprecision(3) << dead_ends
+         << " dead-end leaves (+-" << fixed << setprecision(1) << rse(dead_ends, total.dead_ends_sq) << "%), ";
+    if (leaves > 0) {
+        cout << scientific << setprecision(3) << leaves << " raw solutions (+-" << fixed << setprecision(1)
+             << rse(leaves, total.leaves_sq) << "%)\n";
+    } else {
+        cout << "raw solutions not estimated:  no probe reached one\n";
+    }
+    cout << unixtime() << " Measured " << scientific << setprecision(3) << rate << " nodes/sec with "
+         << num_threads << " worker threads;  projected wall time " << format_duration(nodes / rate) << "\n";
+    cout << defaultfloat << setprecision(6) << flush;
+}
+
+// Features of a task for the cost model below:  a constant, the number of pairs open
+// on each side, the span of the open positions on each side, the count of numbers
+// still available, and whether the task's own frame closes a pair.
+constexpr int kNumFeatures = 7;
+
+template <int n, typename W>
+array<double, kNumFeatures> task_features(const Task<n, W>& task) {
+    array<double, kNumFeatures> x;
+    x[0] = 1;
+    for (int d=0;  d<2;  ++d) {
+        const W mask = task.open[d];
+        x[1 + d] = bit_count(mask);
+        x[3 + d] = mask ? highest_bit(mask) - lowest_bit(mask) + 1 : 0;
+    }
+    x[5] = bit_count(task.avail);
+    x[6] = task.m >= 0;
+    return x;
+}
+
+// Order the tasks so that the ones predicted to be most expensive are claimed first
+// (longest processing time first), which keeps a big subtree from starting last and
+// running alone at the end.  The model is a least-squares fit of log(subtree size) on
+// task_features(), calibrated on an evenly spaced sample of tasks whose subtree sizes
+// are estimated with Knuth probes.  Returns the permutation, and the predicted log
+// subtree size of every task in cost;  tasks keep their ids.
+// The probes use a fixed seed, so the order is reproducible.
+template <int n, typename W>
+vector<uint32_t> order_by_cost(const vector<Task<n, W>>& tasks, int& num_samples, double& r2, vector<double>& cost) {
+    constexpr int kProbesPerSample = 32;
+    const size_t count = tasks.size();
+    num_samples = (int) min<size_t>(count, 256);
+    mt19937_64 rng(count);
+    // normal equations  (X'X) b = X'y  over the sample
+    double xtx[kNumFeatures][kNumFeatures + 1] = {};
+    vector<pair<array<double, kNumFeatures>, double>> sample;
+    for (int s=0;  s<num_samples;  ++s) {
+        const Task<n, W>& task = tasks[count * s / num_samples];
+        double size = 0;
+        for (int i=0;  i<kProbesPerSample;  ++i) {
+            Search<n, W> search;
+            search.rng = &rng;
+            dfs<n, W, kProbe>(task, search);
+            size += search.est_nodes;
+        }
+        const double y = log(size / kProbesPerSample);
+        const array<double, kNumFeatures> x = task_features(task);
+        for (int i=0;  i<kNumFeatures;  ++i) {
+            for (int j=0;  j<kNumFeatures;  ++j) {
+                xtx[i][j] += x[i] * x[j];
+            }
+            xtx[i][kNumFeatures] += x[i] * y;
+        }
+        sample.push_back(make_pair(x, y));
+    }
+    // Gauss-Jordan elimination with partial pivoting;  a tiny ridge keeps it regular
+    // when a feature is constant over the sample
+    for (int i=0;  i<kNumFeatures;  ++i) {
+        xtx[i][i] += 1e-6;
+    }
+    for (int c=0;  c<kNumFeatures;  ++c) {
+        int pivot = c;
+        for (int r=c+1;  r<kNumFeatures;  ++r) {
+            if (fabs(xtx[r][c]) > fabs(xtx[pivot][c])) {
+                pivot = r;
+            }
+        }
+        for (int j=0;  j<=kNumFeatures;  ++j) {
+            swap(xtx[c][j], xtx[pivot][j]);
+        }
+        for (int r=0;  r<kNumFeatures;  ++r) {
+            if (r != c) {
+                const double f = xtx[r][c] / xtx[c][c];
+                for (int j=c;  j<=kNumFeatures;  ++j) {
+                    xtx[r][j] -= f * xtx[c][j];
+                }
+            }
+        }
+    }
+    array<double, kNumFeatures> b;
+    for (int i=0;  i<kNumFeatures;  ++i) {
+        b[i] = xtx[i][kNumFeatures] / xtx[i][i];
+    }
+    auto predict = [&b](const array<double, kNumFeatures>& x) {
+        double y = 0;
+        for (int i=0;  i<kNumFeatures;  ++i) {
+            y += b[i] * x[i];
+        }
+        return y;
+    };
+    double mean = 0, ss_tot = 0, ss_res = 0;
+    for (const auto& xy : sample) {
+        mean += xy.second / sample.size();
+    }
+    for (const auto& xy : sample) {
+        ss_tot += (xy.second - mean) * (xy.second - mean);
+        ss_res += (xy.second - predict(xy.first)) * (xy.second - predict(xy.first));
+    }
+    r2 = ss_tot > 0 ? 1 - ss_res / ss_tot : 1;
+    cost.resize(count);
+    for (size_t i=0;  i<count;  ++i) {
+        cost[i] = predict(task_features(tasks[i]));
+    }
+    vector<uint32_t> order(count);
+    for (size_t i=0;  i<count;  ++i) {
+        order[i] = i;
+    }
+    stable_sort(order.begin(), order.end(), [&cost](uint32_t a, uint32_t b) { return cost[a] > cost[b]; });
+    return order;
+}
+
+// Serve the tasks to --worker processes in the given order and add the solutions they
+// report to results.  A lease is re-issued, ahead of the tasks never handed out, when
+// its connection drops or it is older than --lease-timeout.  The first report for a
+// task wins;  any later one for the same task, from a lease presumed lost, is ignored.
+template <int n, typename W>
+void coordinate(const Options& options, const vector<Task<n, W>>& tasks, const vector<uint32_t>& order,
+                int split_depth, ResultStore<n>& results) {
+    struct Connection {
+        int fd;
+        string inbox;               // bytes received but not yet parsed
+        uint32_t task;              // the task leased to it, or kNoTask
+        long leased_at;
+        bool waiting;               // has reported and awaits its next lease
+    };
+    enum { kPending, kLeased, kDone };
+    const uint32_t num_tasks = tasks.size();
+    vector<int8_t> state(num_tasks, kPending);
+    vector<int64_t> task_nodes(num_tasks, 0);   // search nodes the winning report counted
+    deque<uint32_t> queue(order.begin(), order.end());
+    uint32_t num_done = 0;
+    int64_t num_connections = 0, num_reissued = 0;
+    Hello hello;
+    memcpy(hello.magic, "PLANGFRC", 8);
+    hello.n = n;
+    hello.split_depth = split_depth;
+    hello.num_tasks = num_tasks;
+    hello.more = false;
+    auto it = find(options.ns.begin(), options.ns.end(), n);
+    while (it != options.ns.end() && ++it != options.ns.end()) {
+        hello.more |= (*it % 4 == 0 || *it % 4 == 3);
+    }
+    const int listener = listen_unix(options.coordinator_socket);
+    cout << unixtime() << " Coordinating " << num_tasks << " tasks on " << options.coordinator_socket << "\n";
+    cout << flush;
+    vector<Connection> connections;
+    auto drop = [&](Connection& c) {
+        if (c.task != kNoTask && state[c.task] == kLeased) {
+            state[c.task] = kPending;
+            queue.push_front(c.task);
+            ++num_reissued;
+        }
+        c.task = kNoTask;
+    };
+    vector<char> buffer(1 << 20);
+    while (num_done < num_tasks) {
+        const long now = unixtime();
+        for (Connection& c : connections) {
+            if (c.task != kNoTask && options.lease_timeout > 0 && now - c.leased_at > options.lease_timeout * 1000) {
+                drop(c);
+            }
+            while (c.waiting && !queue.empty()) {
+                const uint32_t t = queue.front();
+                queue.pop_front();
+                if (state[t] == kDone) {
+                    continue;
+                }
+                state[t] = kLeased;
+                c.task = t;
+                c.leased_at = now;
+                c.waiting = false;
+                const Lease lease = {t};
+                if (!send_all(c.fd, &lease, sizeof(lease))) {
+                    drop(c);
+                    close(c.fd);
+                    c.fd = -1;
+                }
+            }
+        }
+        connections.erase(remove_if(connections.begin(), connections.end(),
+                                    [](const Connection& c) { return c.fd < 0; }),
+                          connections.end());
+        vector<pollfd> fds(1 + connections.size());
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for (size_t i=0;  i<connections.size();  ++i) {
+            fds[i + 1].fd = connections[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        if (poll(fds.data(), fds.size(), 1000) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fatal("cannot poll the worker connections");
+        }
+        for (size_t i=0;  i<connections.size();  ++i) {
+            if (!fds[i + 1].revents) {
+                continue;
+            }
+            Connection& c = connections[i];
+            const ssize_t got = recv(c.fd, buffer.data(), buffer.size(), 0);
+            if (got <= 0) {
+                drop(c);
+                close(c.fd);
+                c.fd = -1;
+                continue;
+            }
+            c.inbox.append(buffer.data(), got);
+            size_t used = 0;
+            Report report;
+            while (c.fd >= 0 && c.inbox.size() - used >= sizeof(report)) {
+                memcpy(&report, c.inbox.data() + used, sizeof(report));
+                const size_t length = sizeof(report) + size_t(report.num_keys) * sizeof(Key<n>);
+                if (c.inbox.size() - used < length) {
+                    break;
+                }
+                if (report.task != kNoTask && report.task >= num_tasks) {
+                    cerr << "planar_mt: dropping a worker that reported unknown task " << report.task << "\n";
+                    drop(c);
+                    close(c.fd);
+                    c.fd = -1;
+                    break;
+                }
+                if (report.task != kNoTask && state[report.task] != kDone) {
+                    for (uint32_t j=0;  j<report.num_keys;  ++j) {
+                        Key<n> key;
+                        memcpy(&key, c.inbox.data() + used + sizeof(report) + j * sizeof(key), sizeof(key));
+                        results.add(key);
+                    }
+                    task_nodes[report.task] = report.nodes;
+                    state[report.task] = kDone;
+                    ++num_done;
+                }
+                if (report.task == c.task) {
+                    c.task = kNoTask;
+                }
+                c.waiting = true;
+                used += length;
+            }
+            c.inbox.erase(0, used);
+        }
+        if (fds[0].revents) {
+            const int fd = accept(listener, nullptr, nullptr);
+            if (fd >= 0 && send_all(fd, &hello, sizeof(hello))) {
+                connections.push_back(Connection{fd, string(), kNoTask, 0, false});
+                ++num_connections;
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+    const Lease done = {kNoTask};
+    for (Connection& c : connections) {
+        if (c.fd >= 0) {
+            if (c.waiting) {
+                send_all(c.fd, &done, sizeof(done));
+            }
+            close(c.fd);
+        }
+    }
+    close(listener);
+    unlink(options.coordinator_socket.c_str());
+    int64_t total_nodes = 0, max_nodes = 0;
+    for (int64_t nodes : task_nodes) {
+        total_nodes += nodes;
+        max_nodes = max(max_nodes, nodes);
+    }
+    cout << unixtime() << " Served " << num_tasks << " tasks over " << num_connections
+         << " worker connections;  re-issued " << num_reissued << " leases\n";
+    cout << unixtime() << " Workers reported " << total_nodes << " search nodes, at most "
+         << max_nodes << " in one task\n";
+}
+
+// The --worker side:  rebuild the coordinator's frontier, then have every thread open
+// its own connection and solve leased tasks until told that none are left, or until
+// the coordinator goes away.
+template <int n, typename W = Word<n>>
+void work(const Options& options) {
+    vector<Task<n, W>> tasks;
+    Search<n, W> enumeration;
+    enumeration.split_depth = options.split_depth;
+    enumeration.frontier = &tasks;
+    dfs<n, W, kFrontier>(Task<n, W>::root(), enumeration);
+    atomic<int64_t> num_solved(0);
+    run_on_threads(options.num_threads, [&](int thread_id) {
+        const CpuPin pin(options, thread_id);
+        const int fd = connect_unix(options.worker_socket);
+        Hello hello;
+        if (fd < 0 || !recv_all(fd, &hello, sizeof(hello))) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return;
+        }
+        if (hello.n != n || hello.split_depth != options.split_depth || hello.num_tasks != tasks.size()) {
+            // the coordinator moved on to another n;  the next session will pick it up
+            close(fd);
+            return;
+        }
+        vector<Key<n>> keys;
+        Search<n, W> search;
+        search.keys = &keys;
+        Report report = {kNoTask, 0, 0};
+        Lease lease;
+        while (send_all(fd, &report, sizeof(report)) &&
+               send_all(fd, keys.data(), keys.size() * sizeof(Key<n>)) &&
+               recv_all(fd, &lease, sizeof(lease)) && lease.task < tasks.size()) {
+            keys.clear();
+            search.nodes = 0;
+            dfs<n, W, kSearch>(tasks[lease.task], search);
+            report.task = lease.task;
+            report.num_keys = keys.size();
+            report.nodes = search.nodes;
+            ++num_solved;
+        }
+        close(fd);
+    });
+    cout << unixtime() << " Solved " << num_solved << " of " << tasks.size() << " tasks for n = " << n << "\n";
+    cout << flush;
+}
+
+// The search behind count_planar_langford and for_each_planar_langford:  the frontier
+// tasks, most expensive first, on worker threads that count (and visit) canonical
+// solutions as they reach them, so nothing is stored;  see LIBRARY.
+template <int n, typename W = Word<n>>
+PlanarLangfordStats visit_all(const PlanarLangfordOptions& options, const PlanarLangfordVisitor* visitor) {
+    const double t_start = monotonic_seconds();
+    int cpus_allowed, cgroup_limit;
+    const int num_threads = options.num_threads > 0 ? options.num_threads :
+                                                      default_num_threads(cpus_allowed, cgroup_limit);
+    PlanarLangfordStats stats;
+    stats.split_depth = options.split_depth > 0 ?
+        min(options.split_depth, 2 * n - 1) :
+        choose_split_depth<n, W>(int64_t(kTasksPerWorker) * num_threads);
+    vector<Task<n, W>> tasks;
+    Search<n, W> enumeration;
+    enumeration.split_depth = stats.split_depth;
+    enumeration.frontier = &tasks;
+    dfs<n, W, kFrontier>(Task<n, W>::root(), enumeration);
+    int num_samples;
+    double r2;
+    vector<double> cost;
+    const vector<uint32_t> order = order_by_cost<n, W>(tasks, num_samples, r2, cost);
+    atomic<size_t> next_task(0);
+    vector<Search<n, W>> searches(num_threads);
+    run_on_threads(num_threads, [&](int thread_id) {
+        Search<n, W>& search = searches[thread_id];
+        search.visitor = visitor;
+        for (size_t i;  (i = next_task++) < tasks.size();  ) {
+            dfs<n, W, kVisit>(tasks[order[i]], search);
+        }
+    });
+    for (const Search<n, W>& search : searches) {
+        stats.solutions += search.visited;
+        stats.nodes += search.nodes;
+    }
+    stats.nodes += enumeration.nodes;
+    stats.num_tasks = tasks.size();
+    stats.seconds = monotonic_seconds() - t_start;
+    return stats;
+}
+
+// The suspended search of a PlanarLangfordGenerator.
+struct GeneratorState {
+    virtual ~GeneratorState() {}
+    virtual bool next(int* sequence) = 0;
+};
+
+// A generator cuts the search at the shallowest depth with this many frames;  the
+// subtrees below are searched whole, so finer means less work between solutions.
+constexpr int64_t kGeneratorTasks = 1 << 16;
+
+// The search behind PlanarLangfordGenerator, between calls:  a stack of pending tasks,
+// expanded one level at a time by dfs<n> in mode kFrontier down to the split depth,
+// where each task of this shard is searched whole in mode kVisit and its canonical
+// solutions are handed out one per call;  see LIBRARY.
+template <int n, typename W = Word<n>>
+class GeneratorOf : public GeneratorState {
+  public:
+    GeneratorOf(int shard, int num_shards)
+        : shard(shard), num_shards(num_shards), split_depth(choose_split_depth<n, W>(kGeneratorTasks)),
+          num_tasks(0), next_found(0) {
+        pending.push_back(Task<n, W>::root());
+    }
+
+    bool next(int* sequence) override {
+        while (next_found == found.size()) {
+            if (pending.empty()) {
+                return false;
+            }
+            const Task<n, W> task = pending.back();
+            pending.pop_back();
+            found.clear();
+            next_found = 0;
+            Search<n, W> search;
+            if (task.k == split_depth) {
+                if (num_tasks++ % num_shards == shard) {
+                    search.found = &found;
+                    dfs<n, W, kVisit>(task, search);
+                }
+            } else {
+                // push the children in reverse, so that they pop in search order
+                children.clear();
+                search.split_depth = task.k + 1;
+                search.frontier = &children;
+                dfs<n, W, kFrontier>(task, search);
+                pending.insert(pending.end(), children.rbegin(), children.rend());
+            }
+        }
+        int s[2 * n];
+        to_sequence<n>(found[next_found++], s);
+        copy(s, s + 2 * n, sequence);
+        return true;
+    }
+
+  private:
+    const int64_t shard, num_shards;
+    const int split_depth;
+    int64_t num_tasks;              // tasks at split_depth reached so far, of all shards
+    vector<Task<n, W>> pending;
+    vector<Task<n, W>> children;
+    vector<Positions<n>> found;     // solutions of the last task searched
+    size_t next_found;
+};
+
+// A task that crashes this many worker processes in a row aborts the run.
+constexpr int kMaxAttempts = 3;
+
+// Run the tasks in forked worker processes (--workers processes) that share one
+// anonymous mmap:  a header of counters, a slot per task, a queue of re-issued tasks,
+// and an append-only area of keys.  A worker claims a task from the re-issue queue or
+// else the next one in order, searches it into a private vector, then reserves room in
+// the key area, copies the keys and only then marks the slot done, so a worker that
+// dies at any point leaves nothing half-visible.  The parent reaps workers;  when one
+// dies abnormally, the task it was on goes to the re-issue queue and a replacement is
+// forked.  Finally the parent adds the keys of every done slot to results.
+template <int n, typename W>
+void fork_workers(const Options& options, const vector<Task<n, W>>& tasks, const vector<uint32_t>& order,
+                  ResultStore<n>& results) {
+    enum { kPending, kDone };
+    struct Slot {
+        atomic<uint32_t> state;
+        uint32_t num_keys;
+        uint64_t first_key;
+        int64_t nodes;
+        int attempts;               // touched only by the parent
+    };
+    struct Header {
+        atomic<uint32_t> next;              // into order
+        atomic<uint32_t> reissue_head;      // claimed by workers
+        atomic<uint32_t> reissue_tail;      // published by the parent
+        atomic<uint32_t> num_done;
+        atomic<uint64_t> keys_used;
+        atomic<uint32_t> overflow;
+    };
+    const uint32_t num_tasks = tasks.size();
+    const int num_workers = options.num_threads;
+    // the key area is reserved, not committed:  pages cost memory only once written
+    const size_t key_capacity = size_t(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE) / 2 / sizeof(Key<n>);
+    const size_t slots_at = (sizeof(Header) + 63) / 64 * 64;
+    const size_t reissue_at = slots_at + num_tasks * sizeof(Slot);
+    const size_t current_at = reissue_at + size_t(num_tasks) * kMaxAttempts * sizeof(uint32_t);
+    const size_t keys_at = (current_at + num_workers * sizeof(atomic<uint32_t>) + 63) / 64 * 64;
+    const size_t length = keys_at + key_capacity * sizeof(Key<n>);
+    char* shared = (char*) mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (shared == MAP_FAILED) {
+        fatal("cannot map the shared task area");
+    }
+    Header& header = *new (shared) Header();
+    Slot* slots = (Slot*) (shared + slots_at);
+    for (uint32_t i=0;  i<num_tasks;  ++i) {
+        new (slots + i) Slot();
+    }
+    uint32_t* reissue = (uint32_t*) (shared + reissue_at);
+    atomic<uint32_t>* current = (atomic<uint32_t>*) (shared + current_at);
+    for (int w=0;  w<num_workers;  ++w) {
+        new (current + w) atomic<uint32_t>(kNoTask);
+    }
+    Key<n>* keys = (Key<n>*) (shared + keys_at);
+    auto take = [&]() -> uint32_t {
+        uint32_t head = header.reissue_head.load();
+        while (head < header.reissue_tail.load(memory_order_acquire)) {
+            if (header.reissue_head.compare_exchange_weak(head, head + 1)) {
+                return reissue[head];
+            }
+        }
+        const uint32_t i = header.next++;
+        return i < num_tasks ? order[i] : kNoTask;
+    };
+    auto worker = [&](int w) {
+        if (!options.affinity_cpus.empty()) {
+            pin_to_cpu(options.affinity_cpus[w % options.affinity_cpus.size()]);
+        }
+        vector<Key<n>> found;
+        Search<n, W> search;
+        search.keys = &found;
+        for (uint32_t t;  (t = take()) != kNoTask;  ) {
+            current[w] = t;
+            found.clear();
+            search.nodes = 0;
+            dfs<n, W, kSearch>(tasks[t], search);
+            const uint64_t first = header.keys_used.fetch_add(found.size());
+            if (first + found.size() > key_capacity) {
+                header.overflow = 1;
+                _exit(3);
+            }
+            copy(found.begin(), found.end(), keys + first);
+            slots[t].first_key = first;
+            slots[t].num_keys = found.size();
+            slots[t].nodes = search.nodes;
+            slots[t].state.store(kDone, memory_order_release);
+            ++header.num_done;
+            current[w] = kNoTask;
+        }
+        _exit(0);
+    };
+    auto reissue_task = [&](uint32_t t) {
+        if (++slots[t].attempts > kMaxAttempts) {
+            cerr << "planar_mt: task " << t << " crashed " << kMaxAttempts << " workers;  giving up\n";
+            exit(2);
+        }
+        const uint32_t tail = header.reissue_tail.load();
+        reissue[tail] = t;
+        header.reissue_tail.store(tail + 1, memory_order_release);
+    };
+    vector<pid_t> pids(num_workers, 0);
+    auto spawn = [&](int w) {
+        cout << flush;
+        const pid_t pid = fork();
+        if (pid < 0) {
+            fatal("cannot fork a worker");
+        }
+        if (pid == 0) {
+            worker(w);
+        }
+        pids[w] = pid;
+    };
+    for (int w=0;  w<num_workers;  ++w) {
+        spawn(w);
+    }
+    int num_alive = num_workers;
+    int64_t num_crashed = 0;
+    while (num_alive) {
+        int status;
+        const pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fatal("cannot wait for the workers");
+        }
+        const int w = find(pids.begin(), pids.end(), pid) - pids.begin();
+        if (w == num_workers) {
+            continue;
+        }
+        --num_alive;
+        if (header.overflow) {
+            cerr << "planar_mt: the shared key area of " << key_capacity << " solutions is full\n";
+            exit(2);
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            ++num_crashed;
+            const uint32_t t = current[w];
+            cout << unixtime() << " Worker " << pid << " died (" << (WIFSIGNALED(status) ?
+                "signal " + to_string(WTERMSIG(status)) : "exit status " + to_string(WEXITSTATUS(status)))
+                 << ")";
+            if (t != kNoTask && slots[t].state.load(memory_order_acquire) != kDone) {
+                cout << ";  re-issuing task " << t;
+                reissue_task(t);
+            }
+            cout << "\n";
+            current[w] = kNoTask;
+            spawn(w);
+            ++num_alive;
+        } else if (num_alive == 0 && header.num_done < num_tasks) {
+            // a worker died between claiming a task and recording it as current[w]
+            for (uint32_t t=0;  t<num_tasks;  ++t) {
+                if (slots[t].state.load(memory_order_acquire) != kDone) {
+                    reissue_task(t);
+                }
+            }
+            spawn(w);
+            ++num_alive;
+        }
+    }
+    int64_t nodes = 0;
+    for (uint32_t t=0;  t<num_tasks;  ++t) {
+        for (uint32_t j=0;  j<slots[t].num_keys;  ++j) {
+            results.add(keys[slots[t].first_key + j]);
+        }
+        nodes += slots[t].nodes;
+    }
+    cout << unixtime() << " " << num_workers << " worker processes searched " << nodes << " nodes;  "
+         << num_crashed << " crashed\n";
+    munmap(shared, length);
+}
+
+// Cut the search into frontier tasks (see WORKER THREADS) and decide the order in
+// which to claim them;  cost gets the predicted log subtree sizes, or zeros with
+// --task-order natural.  Returns the split depth.
+template <int n, typename W>
+int plan_tasks(const Options& options, vector<Task<n, W>>& tasks, vector<uint32_t>& order, vector<double>& cost) {
+    const long t_probe = unixtime();
+    const Task<n, W> root = Task<n, W>::root(options.pair_n_open, options.pair_n_side);
+    const int split_depth = options.split_depth ?
+        min(options.split_depth, 2 * n - 1) :
+        choose_split_depth<n, W>(int64_t(kTasksPerWorker) * options.num_threads, root);
+    Search<n, W> enumeration;
+    enumeration.split_depth = split_depth;
+    enumeration.frontier = &tasks;
+    dfs<n, W, kFrontier>(root, enumeration);
+    cout << unixtime() << " Split at depth " << split_depth << " into " << tasks.size()
+         << " tasks in " << (unixtime() - t_probe) << " milliseconds\n";
+    if (options.order_by_cost) {
+        const long t_order = unixtime();
+        int num_samples;
+        double r2;
+        order = order_by_cost<n, W>(tasks, num_samples, r2, cost);
+        cout << unixtime() << " Ordered tasks by predicted cost;  model fit on " << num_samples
+             << " sampled tasks with R^2 = " << fixed << setprecision(2) << r2 << defaultfloat
+             << setprecision(6) << " in " << (unixtime() - t_order) << " milliseconds\n";
+    } else {
+        cost.assign(tasks.size(), 0);
+        for (size_t i=0;  i<tasks.size();  ++i) {
+            order.push_back(i);
+        }
+    }
+    return split_depth;
+}
+
+// --emit-order search:  count, and emit if asked, the canonical solutions task by task
+// in frontier order, without storing or sorting them all;  see EMITTING ALL SOLUTION
+// SEQUENCES.  Each worker sorts the solutions of its task;  whoever completes the
+// oldest unwritten task writes it, and every later one that is ready, under mtx.
+// Returns -1 if stopped early, with the partial output file removed.
+constexpr int64_t kSearchOrderTasks = 4096;
+
+template <int n, typename W>
+int64_t stream_solutions(const Options& options, PhaseTimes* times) {
+    const double t_plan = monotonic_seconds();
+    Options planned = options;
+    planned.order_by_cost = false;
+    if (!planned.split_depth) {
+        // the output is in frontier order, so the frontier must not depend on --threads
+        planned.split_depth = choose_split_depth<n, W>(
+            kSearchOrderTasks, Task<n, W>::root(options.pair_n_open, options.pair_n_side));
+    }
+    vector<Task<n, W>> tasks;
+    vector<uint32_t> order;
+    vector<double> cost;
+    times->split_depth = plan_tasks<n, W>(planned, tasks, order, cost);
+    times->num_tasks = tasks.size();
+    const string path = expand_path(options.emit_path, n);
+    unique_ptr<SolutionWriter> writer;
+    if (!options.emit_path.empty()) {
+        writer.reset(new SolutionWriter(path, n, KeyLayout<n>::kPosBits, options.emit_binary));
+    }
+    cout << flush;
+    const double t_search = monotonic_seconds();
+    times->plan = t_search - t_plan;
+    mutex mtx;
+    // the sorted solutions of each task finished but not yet written, under mtx
+    vector<vector<Key<n>>> finished(tasks.size());
+    vector<uint8_t> done(tasks.size(), 0);
+    size_t next_write = 0;
+    int64_t unique = 0;
+    double output_seconds = 0;
+    atomic<size_t> next_task(0);
+    run_on_threads(options.num_threads, [&](int thread_id) {
+        const CpuPin pin(options, thread_id);
+        vector<Positions<n>> found;
+        Search<n, W> search;
+        search.found = &found;
+        search.stop = &stop_requested;
+        for (size_t t;  !stop_requested && (t = next_task++) < tasks.size();  ) {
+            found.clear();
+            dfs<n, W, kVisit>(tasks[t], search);
+            if (search.abandoned) {
+                break;
+            }
+            vector<Key<n>> keys;
+            keys.reserve(found.size());
+            for (const Positions<n>& pos : found) {
+                keys.push_back(pack<n>(pos));
+            }
+            sort(keys.begin(), keys.end());
+            lock_guard<mutex> lock(mtx);
+            finished[t].swap(keys);
+            done[t] = 1;
+            const double t_write = monotonic_seconds();
+            for (;  next_write < tasks.size() && done[next_write];  ++next_write) {
+                unique += finished[next_write].size();
+                if (writer) {
+                    for (const Key<n>& key : finished[next_write]) {
+                        writer->write<n>(key);
+                    }
+                }
+                vector<Key<n>>().swap(finished[next_write]);
+            }
+            output_seconds += monotonic_seconds() - t_write;
+        }
+    });
+    const double t_flush = monotonic_seconds();
+    times->search = t_flush - t_search;
+    writer.reset();
+    times->output = output_seconds + monotonic_seconds() - t_flush;
+    if (stop_requested) {
+        // there is nothing to resume from, so leave no truncated file behind
+        if (!options.emit_path.empty() && path != "-") {
+            unlink(path.c_str());
+        }
+        return -1;
+    }
+    times->raw = unique;
+    if (!options.emit_path.empty()) {
+        cout << unixtime() << " Wrote " << unique << " solutions to " << path << " in search order\n";
+    }
+    return unique;
+}
+
+// "p@below" or "p@above":  the shard with the pair n opening at position p on that side.
+string pair_n_shard(int open, int side) {
+    return to_string(open) + (side ? "@above" : "@below");
+}
+
+// --pair-n all:  solve every shard of the pair n in turn, as --emit-order search does,
+// and report each;  see SHARDS BY THE PAIR N.  Returns the total, or -1 if stopped.
+template <int n, typename W>
+int64_t solve_pair_n_shards(const Options& options, PhaseTimes* times) {
+    int64_t total = 0;
+    for (int open=0;  open + n + 1 < 2 * n;  ++open) {
+        for (int side=0;  side<2;  ++side) {
+            Options shard = options;
+            shard.pair_n_all = false;
+            shard.pair_n_open = open;
+            shard.pair_n_side = side;
+            const long t_start = unixtime();
+            PhaseTimes shard_times;
+            const int64_t cnt = stream_solutions<n, W>(shard, &shard_times);
+            if (cnt < 0) {
+                return -1;
+            }
+            cout << unixtime() << " Shard " << pair_n_shard(open, side) << " of n = " << n << " has " << cnt
+                 << " solutions, took " << (unixtime() - t_start) << " milliseconds\n";
+            cout << flush;
+            total += cnt;
+            times->plan += shard_times.plan;
+            times->search += shard_times.search;
+            times->output += shard_times.output;
+            times->num_tasks += shard_times.num_tasks;
+            times->split_depth = max(times->split_depth, shard_times.split_depth);
+        }
+    }
+    times->raw = total;
+    return total;
+}
+
+// Search one frontier task (--replay-task) alone on this thread, and report on it;
+// see REPLAYING A TASK.
+template <int n, typename W = Word<n>>
+void replay(const Options& options) {
+    Options planned = options;
+    planned.order_by_cost = false;
+    vector<Task<n, W>> tasks;
+    vector<uint32_t> order;
+    vector<double> cost;
+    const int split_depth = plan_tasks<n, W>(planned, tasks, order, cost);
+    if (size_t(options.replay_task) >= tasks.size()) {
+        cerr << "planar_mt: there is no task " << options.replay_task << " among the " << tasks.size()
+             << " at depth " << split_depth << "\n";
+        exit(2);
+    }
+    const Task<n, W>& task = tasks[options.replay_task];
+    cout << unixtime() << " Task " << options.replay_task << " places";
+    int num_placed = 0;
+    for (int m=0;  m<n;  ++m) {
+        if (!((task.avail >> m) & 1)) {
+            cout << " " << m + 1 << "@" << task.pos[m] - m - 2 << "," << int(task.pos[m]);
+            ++num_placed;
+        }
+    }
+    cout << (num_placed ? "" : " no pairs") << " of " << int(task.num_open) << " opened, and at position " << int(task.k)
+         << (task.m < 0 ? " opens a pair " : " closes " + to_string(task.m + 1) + " ")
+         << (task.d ? "above\n" : "below\n");
+    cout << flush;
+    const CpuPin pin(options, 0);
+    vector<Key<n>> keys;
+    Search<n, W> search;
+    search.keys = &keys;
+    search.stop = &stop_requested;
+    const double t_start = monotonic_seconds();
+    dfs<n, W, kSearch>(task, search);
+    const double seconds = monotonic_seconds() - t_start;
+    cout << unixtime() << (search.abandoned ? " Stopped early;  searched " : " Searched ") << search.nodes << " nodes in " << fixed << setprecision(3) << seconds
+         << " seconds (" << scientific << setprecision(3) << search.nodes / max(seconds, 1e-9) << " nodes/sec), "
+         << defaultfloat << setprecision(6) << "finding " << keys.size() << " raw solutions\n";
+    cout << flush;
+    if (search.abandoned) {
+        exit(kExitStopped);
+    }
+}
+
+// Count the unique solutions in results, emitting them if --emit asks for it.
+template <int n>
+int64_t finish_results(const Options& options, ResultStore<n>& results, PhaseTimes* times = nullptr) {
+    PhaseTimes ignored;
+    if (!times) {
+        times = &ignored;
+    }
+    const string path = expand_path(options.emit_path, n);
+    unique_ptr<SolutionWriter> writer;
+    if (!options.emit_path.empty()) {
+        writer.reset(new SolutionWriter(path, n, KeyLayout<n>::kPosBits, options.emit_binary));
+    }
+    const int64_t unique = results.finish(writer.get(), times);
+    if (writer) {
+        const double t_flush = monotonic_seconds();
+        writer.reset();
+        times->output += monotonic_seconds() - t_flush;
+        cout << unixtime() << " Wrote " << unique << " solutions to " << path << "\n";
+    }
+    if (results.num_runs()) {
+        cout << unixtime() << " Merged " << results.num_runs() << " spilled runs of "
+             << results.num_spilled() << " solutions\n";
+    }
+    return unique;
+}
+
+// A progress file is a short text file naming n, the split depth, the number of tasks
+// and which of them are done;  the unique solutions of the done tasks go alongside in
+// PATH.keys, in the --emit binary format.  Both are written to temporaries and renamed
+// into place, keys first:  a crash between the renames pairs old flags with newer keys,
+// and resuming from that merely redoes some tasks, whose duplicates dedup removes.
+template <int n>
+void save_progress(const string& path, int split_depth, const vector<uint8_t>& done, ResultStore<n>& results) {
+    int64_t unique;
+    {
+        SolutionWriter writer(path + ".keys.tmp", n, KeyLayout<n>::kPosBits, true);
+        unique = results.finish(&writer);
+    }
+    FILE* f = fopen((path + ".tmp").c_str(), "w");
+    if (!f) {
+        fatal("cannot create " + path + ".tmp");
+    }
+    fprintf(f, "planar_mt progress 1\nn %d\nsplit_depth %d\ntasks %zu\ndone ", n, split_depth, done.size());
+    for (uint8_t d : done) {
+        fputc('0' + d, f);
+    }
+    fputc('\n', f);
+    if (fflush(f) || fsync(fileno(f)) || fclose(f) ||
+        rename((path + ".keys.tmp").c_str(), (path + ".keys").c_str()) ||
+        rename((path + ".tmp").c_str(), path.c_str())) {
+        fatal("cannot write " + path);
+    }
+    cout << unixtime() << " Saved progress to " << path << ":  " << count(done.begin(), done.end(), 1)
+         << " of " << done.size() << " tasks done, " << unique << " unique solutions so far\n";
+}
+
+// Read a progress file written by save_progress<n>, adding its solutions to results.
+template <int n>
+void load_progress(const string& path, int& split_depth, vector<uint8_t>& done, ResultStore<n>& results) {
+    FILE* f = fopen(path.c_str(), "r");
+    int version, file_n;
+    size_t num_tasks;
+    if (!f) {
+        fatal("cannot resume from " + path);
+    }
+    if (fscanf(f, "planar_mt progress %d n %d split_depth %d tasks %zu done ",
+               &version, &file_n, &split_depth, &num_tasks) != 4 || version != 1 || file_n != n) {
+        cerr << "planar_mt: cannot resume from " << path << ":  not a progress file for n = " << n << "\n";
+        exit(2);
+    }
+    done.assign(num_tasks, 0);
+    for (size_t i=0;  i<num_tasks;  ++i) {
+        done[i] = (fgetc(f) == '1');
+    }
+    fclose(f);
+    int keys_n;
+    vector<int8_t> pos;
+    string error;
+    if (!load_solutions(path + ".keys", keys_n, pos, error) || keys_n != n) {
+        cerr << "planar_mt: cannot resume from " << path << ".keys:  " << error << "\n";
+        exit(2);
+    }
+    Positions<n> p;
+    for (size_t i=0;  i<pos.size();  i+=n) {
+        copy(pos.begin() + i, pos.begin() + i + n, p.begin());
+        results.add(pack<n>(p));
+    }
+    cout << unixtime() << " Resuming from " << path << ":  " << count(done.begin(), done.end(), 1)
+         << " of " << num_tasks << " tasks done, " << pos.size() / n << " unique solutions so far\n";
+}
+
+// This is the main function of the sequential algorithm.  If times is non-null, it
+// receives the phase timings and sizes for the run log;  if trace is non-null, it
+// receives the --trace rings of a completed run, for the caller to write.
+template <int n, typename W = Word<n>>
+int64_t solve(const Options& options, PhaseTimes* times = nullptr, vector<TraceRing>* trace = nullptr) {
+    if (n <= 0 || n > kMaxN || n % 4 == 1 || n % 4 == 2) {
+        return 0;
+    }
+    PhaseTimes ignored;
+    if (!times) {
+        times = &ignored;
+    }
+    if (options.pair_n_all) {
+        return solve_pair_n_shards<n, W>(options, times);
+    }
+    // a shard must count each solution in its canonical embedding only, to not count
+    // it again in the shard with the pair n on the other side
+    if (options.emit_in_search_order || options.pair_n_open >= 0) {
+        return stream_solutions<n, W>(options, times);
+    }
+    const double t_plan = monotonic_seconds();
+    // rings[0] for this thread, rings[i + 1] for worker i;  see TRACING
+    const int num_threads = options.coordinator_socket.empty() && !options.fork ? options.num_threads : 0;
+    vector<TraceRing> rings(options.trace_path.empty() ? 0 : 1 + num_threads);
+    for (TraceRing& ring : rings) {
+        ring.enable(t_plan);
+    }
+    TraceRing no_trace;
+    TraceRing& main_ring = rings.empty() ? no_trace : rings[0];
+    vector<Task<n, W>> tasks;
+    vector<uint32_t> order;
+    StealPool<n, W> pool;
+    int split_depth = 0;
+    if (options.steal) {
+        pool.tasks.push_back(Task<n, W>::root());
+    }
+    ResultStore<n> results(options);
+    // done[i] is set once the solutions of tasks[i] are all in results
+    vector<uint8_t> done;
+    const string progress_path = expand_path(options.progress_path, n);
+    const bool resumed = options.resume && access(progress_path.c_str(), F_OK) == 0;
+    if (!options.steal) {
+        Options planned = options;
+        if (resumed) {
+            load_progress<n>(progress_path, planned.split_depth, done, results);
+        }
+        vector<double> cost;
+        split_depth = plan_tasks<n, W>(planned, tasks, order, cost);
+        times->split_depth = split_depth;
+        times->num_tasks = tasks.size();
+        if (resumed && done.size() != tasks.size()) {
+            cerr << "planar_mt: " << progress_path << " was written for a different frontier\n";
+            exit(2);
+        }
+        done.resize(tasks.size(), 0);
+    }
+    cout << flush;
+    main_ring.span("plan", 0);
+    const double t_search = monotonic_seconds();
+    const int64_t trace_search = main_ring.now();
+    times->plan = t_search - t_plan;
+    // with --coordinator or --workers processes the tasks go to processes instead of threads
+    int num_running = num_threads;
+    double t_finish = t_search;     // when the last worker finished, under mtx
+    condition_variable finished_cv; // notified then
+    mutex mtx;
+    atomic<size_t> next_task(0);
+    // for --metrics
+    struct WorkerStats {
+        atomic<int64_t> nodes;
+        atomic<int64_t> busy_ms;    // in finished tasks
+        atomic<long> task_start;    // 0 while idle
+    };
+    vector<WorkerStats> stats(num_threads);
+    int64_t num_raw = 0;            // solutions added to results by this run, under mtx
+    for (int thread_id=0;  thread_id < num_threads;  ++thread_id) {
+        stats[thread_id].nodes = stats[thread_id].busy_ms = stats[thread_id].task_start = 0;
+    }
+    for (int thread_id=0;  thread_id < num_threads;  ++thread_id) {
+        auto thread_func = [&](int thread_id) {
+            if (!options.affinity_cpus.empty()) {
+                pin_to_cpu(options.affinity_cpus[thread_id % options.affinity_cpus.size()]);
+            }
+            Search<n, W> search;
+            search.results = &results;
+            search.mtx = &mtx;
+            search.pool = &pool;
+            // stage each task's solutions, so that an abandoned task leaves none behind
+            vector<Key<n>> keys;
+            search.keys = &keys;
+            search.stop = &stop_requested;
+            WorkerStats& my = stats[thread_id];
+            search.live_nodes = &my.nodes;
+            TraceRing& ring = rings.empty() ? no_trace : rings[thread_id + 1];
+            int64_t trace_task = 0;
+            auto start_task = [&my, &ring, &trace_task]() {
+                my.task_start = unixtime();
+                trace_task = ring.now();
+            };
+            auto end_task = [&my, &search, &ring, &trace_task](int64_t task) {
+                ring.span("task", trace_task, task);
+                my.nodes = search.nodes;
+                my.busy_ms += unixtime() - my.task_start;
+                my.task_start = 0;
+            };
+            for (size_t i;  !stop_requested && (i = next_task++) < tasks.size();  ) {
+                const uint32_t t = order[i];
+                if (done[t]) {
+                    continue;
+                }
+                keys.clear();
+                start_task();
+                dfs<n, W, kSearch>(tasks[t], search);
+                end_task(t);
+                if (search.abandoned) {
+                    break;
+                }
+                const int64_t trace_lock = ring.now();
+                lock_guard<mutex> lock(mtx);
+                ring.span("lock", trace_lock);
+                for (const Key<n>& key : keys) {
+                    results.add(key);
+                }
+                num_raw += keys.size();
+                done[t] = 1;
+            }
+            // with --schedule steal, tasks is empty and all work flows through pool
+            unique_lock<mutex> lock(pool.mtx);
+            while (options.steal) {
+                if (!pool.tasks.empty()) {
+                    const Task<n, W> task = pool.tasks.back();
+                    pool.tasks.pop_back();
+                    ++pool.busy;
+                    lock.unlock();
+                    keys.clear();
+                    start_task();
+                    dfs<n, W, kSteal>(task, search);
+                    end_task(-1);
+                    const int64_t trace_lock = ring.now();
+                    mtx.lock();
+                    ring.span("lock", trace_lock);
+                    for (const Key<n>& key : keys) {
+                        results.add(key);
+                    }
+                    num_raw += keys.size();
+                    mtx.unlock();
+                    lock.lock();
+                    if (--pool.busy == 0 && pool.tasks.empty()) {
+                        pool.cv.notify_all();
+                    }
+                } else if (pool.busy == 0) {
+                    break;
+                } else {
+                    ++pool.hungry;
+                    const int64_t trace_idle = ring.now();
+                    pool.cv.wait(lock);
+                    ring.span("idle", trace_idle);
+                    --pool.hungry;
+                }
+            }
+            lock.unlock();
+            mtx.lock();
+            if (--num_running == 0) {
+                t_finish = monotonic_seconds();
+                finished_cv.notify_all();
+            }
+            mtx.unlock();
+        };
+        thread(thread_func, thread_id).detach();
+    }
+    if (!options.coordinator_socket.empty()) {
+        coordinate<n, W>(options, tasks, order, split_depth, results);
+    } else if (options.fork) {
+        fork_workers<n, W>(options, tasks, order, results);
+    }
+    if (!num_threads) {
+        t_finish = monotonic_seconds();
+    }
+    // Prometheus text format;  see MONITORING at the top of this file
+    const long t_start = unixtime();
+    long t_metrics = t_start;
+    int64_t metrics_nodes = 0;
+    auto write_metrics = [&]() {
+        const long now = unixtime();
+        const string label = "n=\"" + to_string(n) + "\"";
+        int64_t nodes = 0;
+        for (const WorkerStats& w : stats) {
+            nodes += w.nodes;
+        }
+        string text;
+        metric_family(text, "planar_langford_nodes_total", "counter", "Search tree nodes visited");
+        metric_sample(text, "planar_langford_nodes_total", label, nodes);
+        metric_family(text, "planar_langford_nodes_per_second", "gauge", "Nodes per second since the last write");
+        metric_sample(text, "planar_langford_nodes_per_second", label,
+                      now > t_metrics ? (nodes - metrics_nodes) * 1000.0 / (now - t_metrics) : 0);
         mtx.lock();
-        done = (num_running == 0);
+        const int64_t raw = num_raw;
+        const int64_t tasks_done = count(done.begin(), done.end(), 1);
         mtx.unlock();
+        metric_family(text, "planar_langford_solutions_found_total", "counter", "Raw solutions found, before dedup");
+        metric_sample(text, "planar_langford_solutions_found_total", label, raw);
+        if (!options.steal) {
+            metric_family(text, "planar_langford_tasks_done", "gauge", "Frontier tasks finished");
+            metric_sample(text, "planar_langford_tasks_done", label, tasks_done);
+            metric_family(text, "planar_langford_tasks_total", "gauge", "Frontier tasks in all");
+            metric_sample(text, "planar_langford_tasks_total", label, tasks.size());
+        }
+        metric_family(text, "planar_langford_worker_idle_fraction", "gauge",
+                      "Fraction of the run each worker spent outside a task");
+        for (int w=0;  w<num_threads;  ++w) {
+            const long task_start = stats[w].task_start;
+            const int64_t busy = stats[w].busy_ms + (task_start ? now - task_start : 0);
+            metric_sample(text, "planar_langford_worker_idle_fraction", label + ",worker=\"" + to_string(w) + "\"",
+                          now > t_start ? max(0.0, 1 - double(busy) / (now - t_start)) : 0);
+        }
+        metric_family(text, "planar_langford_resident_memory_bytes", "gauge", "Resident set size of the solver");
+        metric_sample(text, "planar_langford_resident_memory_bytes", label, resident_bytes());
+        if (!replace_file(options.metrics_path, text)) {
+            // a full disk must not end a long solve;  try again at the next interval
+            warn("cannot write " + options.metrics_path + ", skipping this update");
+        }
+        t_metrics = now;
+        metrics_nodes = nodes;
+    };
+    bool finished = false;
+    while (!finished) {
+        {
+            // wake every 50 ms for the deadline and metrics, and at once when done
+            unique_lock<mutex> lock(mtx);
+            finished = finished_cv.wait_for(lock, chrono::milliseconds(50), [&] { return num_running == 0; });
+        }
+        if (!finished && options.deadline && monotonic_seconds() >= options.deadline && !stop_requested) {
+            cout << unixtime() << " Time limit reached;  stopping\n";
+            stop_requested = true;
+        }
+        if (!options.metrics_path.empty() && (finished || unixtime() - t_metrics >= options.metrics_interval * 1000)) {
+            write_metrics();
+        }
+    }
+    times->search = t_finish - t_search;
+    main_ring.span("search", trace_search);
+    if (stop_requested) {
+        save_progress<n>(progress_path, split_depth, done, results);
+        return -1;
+    }
+    if (resumed) {
+        unlink(progress_path.c_str());
+        unlink((progress_path + ".keys").c_str());
+    }
+    if (options.steal) {
+        cout << unixtime() << " Balanced by " << pool.donations << " stack frames donated to idle workers\n";
+    }
+    const int64_t trace_finish = main_ring.now();
+    const int64_t unique = finish_results<n>(options, results, times);
+    if (!rings.empty()) {
+        main_ring.span("finish", trace_finish);
+        if (trace) {
+            trace->swap(rings);
+        }
+    }
+    return unique;
+}
+
+// One n of a sweep (--sweep):  its frontier tasks with their predicted costs, and the
+// solutions found so far.  Type-erased, so that the tasks of every n in the sweep can
+// share one queue and one pool of worker threads.
+struct SweepJob {
+    int target_n;
+    long t_start;
+    vector<uint32_t> order;
+    vector<double> cost;            // predicted log subtree size of each task
+    atomic<size_t> remaining;       // tasks not yet finished
+    PhaseTimes times;
+    virtual ~SweepJob() {}
+    virtual void run_task(uint32_t i) = 0;
+    virtual int64_t finish() = 0;   // the unique count;  call once, after the last task
+};
+
+template <int n, typename W = Word<n>>
+struct SweepJobOf : SweepJob {
+    const Options& options;
+    vector<Task<n, W>> tasks;
+    ResultStore<n> results;
+    mutex mtx;
+
+    explicit SweepJobOf(const Options& options) : options(options), results(options) {
+        target_n = n;
+        t_start = unixtime();
+        cout << t_start << " Planning Planar Langford for n = " << n << "\n";
+        const double t_plan = monotonic_seconds();
+        times.split_depth = plan_tasks<n, W>(options, tasks, order, cost);
+        times.plan = monotonic_seconds() - t_plan;
+        times.num_tasks = tasks.size();
+        remaining = tasks.size();
+    }
+
+    void run_task(uint32_t i) override {
+        Search<n, W> search;
+        search.results = &results;
+        search.mtx = &mtx;
+        dfs<n, W, kSearch>(tasks[i], search);
+    }
+
+    int64_t finish() override {
+        return finish_results<n>(options, results, &times);
+    }
+};
+
+
+// ----------------------------- crux of solution ends here -------------------------------
+// The rest is boring utilities for pretty printing, argument parsing, validation, etc.
+// ----------------------------------------------------------------------------------------
+
+// Return number of milliseconds elapsed since Jan 1, 1970 00:00 GMT.
+long unixtime() {
+    // There is the unix way, the navy way, and the C++11 way... apparently.
+    using namespace chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    // Using steady_clock instead of system_clock above produces comically incorrect results.
+    // Probably steady_clock has the wrong epoch start.
+}
+
+// Replace "{n}" in a path pattern with n.
+string expand_path(const string& pattern, int n) {
+    string path = pattern;
+    const size_t brace = path.find("{n}");
+    if (brace != string::npos) {
+        path.replace(brace, 3, to_string(n));
+    }
+    return path;
+}
+
+// Append the HELP and TYPE lines of a metric to text, in the Prometheus text format.
+void metric_family(string& text, const string& name, const char* type, const char* help) {
+    text += "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+}
+
+void metric_sample(string& text, const string& name, const string& labels, double value) {
+    char number[64];
+    snprintf(number, sizeof(number), "%.10g", value);
+    text += name + "{" + labels + "} " + number + "\n";
+}
+
+// Write text to path.tmp and rename it over path, so readers never see a partial file.
+bool replace_file(const string& path, const string& text) {
+    const string tmp = path + ".tmp";
+    const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const bool written = write(fd, text.data(), text.size()) == (ssize_t) text.size();
+    if (close(fd) || !written || rename(tmp.c_str(), path.c_str())) {
+        const int saved = errno;
+        unlink(tmp.c_str());
+        errno = saved;
+        return false;
+    }
+    return true;
+}
+
+// Whether replace_file(path, ...) can create its temporary next to path, i.e., whether
+// the directory exists and is writable;  for checking output paths up front.
+bool can_create(const string& path) {
+    const string tmp = path + ".tmp";
+    const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    unlink(tmp.c_str());
+    return true;
+}
+
+// Write the spans of rings in the Chrome trace event format, which chrome://tracing and
+// ui.perfetto.dev display as a timeline with one row per ring:  "main" for rings[0],
+// "worker i" for rings[i + 1].  Returns false, with errno set, if it cannot.
+bool write_trace(const string& path, const vector<TraceRing>& rings) {
+    string text = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char line[256];
+    for (size_t tid=0;  tid < rings.size();  ++tid) {
+        const TraceRing& ring = rings[tid];
+        const string name = tid ? "worker " + to_string(tid - 1) : "main";
+        snprintf(line, sizeof(line),
+                 "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                 tid, name.c_str());
+        text += (tid ? ",\n" : "") + string(line);
+        const size_t first = ring.recorded > TraceRing::kCapacity ? ring.recorded - TraceRing::kCapacity : 0;
+        for (size_t i=first;  i < ring.recorded;  ++i) {
+            const TraceEvent& e = ring.events[i % TraceRing::kCapacity];
+            snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%lld,\"dur\":%lld",
+                     e.name, tid, (long long) e.start, (long long) e.duration);
+            text += line;
+            text += e.task >= 0 ? ",\"args\":{\"task\":" + to_string(e.task) + "}}" : "}";
+        }
+    }
+    return replace_file(path, text + "\n]}\n");
+}
+
+// Ask the workers to wind down;  see STOPPING AND RESUMING.
+void request_stop(int) {
+    stop_requested = true;
+}
+
+// Seconds on a clock that never jumps, for measuring durations.
+double monotonic_seconds() {
+    using namespace chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Render a duration in the most readable of seconds, minutes, hours or days.
+string format_duration(double seconds) {
+    const char* units[] = {"seconds", "minutes", "hours", "days"};
+    const double sizes[] = {1, 60, 3600, 86400};
+    int u = 0;
+    while (u < 3 && seconds >= 2 * sizes[u + 1]) {
+        ++u;
+    }
+    char text[64];
+    snprintf(text, sizeof(text), "%.1f %s", seconds / sizes[u], units[u]);
+    return text;
+}
+
+// Pin the calling thread to one logical CPU.
+void pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set)) {
+        fatal("cannot pin a worker to cpu " + to_string(cpu));
+    }
+}
+
+// The CPUs this process may run on, as they were at the first call, which main
+// makes before any thread is pinned.
+const cpu_set_t& process_cpus() {
+    static cpu_set_t allowed;
+    static const bool known = !sched_getaffinity(0, sizeof(allowed), &allowed);
+    if (!known) {
+        CPU_ZERO(&allowed);
+    }
+    return allowed;
+}
+
+// Let the calling thread run on every CPU of the process again.
+void unpin_thread() {
+    if (CPU_COUNT(&process_cpus()) && sched_setaffinity(0, sizeof(cpu_set_t), &process_cpus())) {
+        fatal("cannot unpin a worker");
+    }
+}
+
+// Read a small integer from a sysfs file, or return fallback if it is missing.
+int read_sysfs_int(const string& path, int fallback) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return fallback;
+    }
+    char text[32];
+    const ssize_t r = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (r <= 0) {
+        return fallback;
+    }
+    text[r] = 0;
+    return atoi(text);
+}
+
+// Return the first line of a file, or "" if it cannot be read.
+string read_first_line(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return "";
+    }
+    char text[4096];
+    const ssize_t r = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (r <= 0) {
+        return "";
+    }
+    text[r] = 0;
+    return string(text, strcspn(text, "\n"));
+}
+
+// Resident set size of this process, from /proc/self/statm, or 0 if unavailable.
+int64_t resident_bytes() {
+    long long size = 0, resident = 0;
+    sscanf(read_first_line("/proc/self/statm").c_str(), "%lld %lld", &size, &resident);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// The CFS bandwidth limit of our cgroup in CPUs, rounded up, or 0 if there is none.
+// Checks cgroup v2 (cpu.max) and then v1 (cpu.cfs_quota_us and cpu.cfs_period_us),
+// first at our own cgroup's path and then at the mount root, as seen from inside
+// a container.
+int cgroup_cpu_limit() {
+    string v2_path, v1_path;
+    const int fd = open("/proc/self/cgroup", O_RDONLY);
+    if (fd >= 0) {
+        string data;
+        char chunk[4096];
+        ssize_t r;
+        while ((r = read(fd, chunk, sizeof(chunk))) > 0) {
+            data.append(chunk, r);
+        }
+        close(fd);
+        // lines look like "0::/kubepods/pod1234" (v2) or "4:cpu,cpuacct:/docker/abcd" (v1)
+        size_t start = 0;
+        while (start < data.size()) {
+            size_t end = data.find('\n', start);
+            if (end == string::npos) {
+                end = data.size();
+            }
+            const string line = data.substr(start, end - start);
+            start = end + 1;
+            const size_t c1 = line.find(':');
+            const size_t c2 = line.find(':', c1 + 1);
+            if (c1 == string::npos || c2 == string::npos) {
+                continue;
+            }
+            const string controllers = "," + line.substr(c1 + 1, c2 - c1 - 1) + ",";
+            if (controllers == ",,") {
+                v2_path = line.substr(c2 + 1);
+            } else if (controllers.find(",cpu,") != string::npos) {
+                v1_path = line.substr(c2 + 1);
+            }
+        }
+    }
+    for (const string& dir : {"/sys/fs/cgroup" + v2_path, string("/sys/fs/cgroup")}) {
+        const string line = read_first_line(dir + "/cpu.max");
+        if (!line.empty()) {
+            long long quota, period;
+            if (sscanf(line.c_str(), "%lld %lld", &quota, &period) == 2 && quota > 0 && period > 0) {
+                return (int) ((quota + period - 1) / period);
+            }
+            return 0;   // "max 100000"
+        }
+    }
+    for (const string& root : {string("/sys/fs/cgroup/cpu,cpuacct"), string("/sys/fs/cgroup/cpu")}) {
+        for (const string& dir : {root + v1_path, root}) {
+            const string quota_line = read_first_line(dir + "/cpu.cfs_quota_us");
+            const string period_line = read_first_line(dir + "/cpu.cfs_period_us");
+            if (!quota_line.empty() && !period_line.empty()) {
+                const long long quota = atoll(quota_line.c_str());
+                const long long period = atoll(period_line.c_str());
+                return (quota > 0 && period > 0) ? (int) ((quota + period - 1) / period) : 0;
+            }
+        }
+    }
+    return 0;
+}
+
+// The default number of worker threads;  see WORKER THREADS at the top of this file.
+int default_num_threads(int& cpus_allowed, int& cgroup_limit) {
+    cpus_allowed = CPU_COUNT(&process_cpus());
+    if (cpus_allowed <= 0) {
+        cpus_allowed = max(1u, thread::hardware_concurrency());
+    }
+    cgroup_limit = cgroup_cpu_limit();
+    return cgroup_limit ? min(cpus_allowed, cgroup_limit) : cpus_allowed;
+}
+
+// Order the CPUs in this process' affinity mask according to an --affinity policy;
+// see THREAD PLACEMENT at the top of this file.
+vector<int> affinity_order(const string& policy) {
+    struct LogicalCpu {
+        int id, package, core, smt, core_rank;
+    };
+    const cpu_set_t& allowed = process_cpus();
+    if (!CPU_COUNT(&allowed)) {
+        fatal("cannot read the cpu affinity mask");
+    }
+    vector<LogicalCpu> cpus;
+    for (int id=0;  id<CPU_SETSIZE;  ++id) {
+        if (CPU_ISSET(id, &allowed)) {
+            const string dir = "/sys/devices/system/cpu/cpu" + to_string(id) + "/topology/";
+            cpus.push_back({id, read_sysfs_int(dir + "physical_package_id", 0),
+                            read_sysfs_int(dir + "core_id", id), 0, 0});
+        }
+    }
+    // smt = rank among siblings of the same core;  core_rank = rank of the core in its package
+    sort(cpus.begin(), cpus.end(), [](const LogicalCpu& a, const LogicalCpu& b) {
+        return make_tuple(a.package, a.core, a.id) < make_tuple(b.package, b.core, b.id);
+    });
+    for (size_t i=1;  i<cpus.size();  ++i) {
+        const LogicalCpu& prev = cpus[i - 1];
+        LogicalCpu& cpu = cpus[i];
+        if (cpu.package == prev.package && cpu.core == prev.core) {
+            cpu.smt = prev.smt + 1;
+            cpu.core_rank = prev.core_rank;
+        } else {
+            cpu.core_rank = (cpu.package == prev.package) ? prev.core_rank + 1 : 0;
+        }
+    }
+    if (policy == "physical") {
+        cpus.erase(remove_if(cpus.begin(), cpus.end(), [](const LogicalCpu& c) { return c.smt > 0; }),
+                   cpus.end());
+    } else if (policy == "scatter") {
+        sort(cpus.begin(), cpus.end(), [](const LogicalCpu& a, const LogicalCpu& b) {
+            return make_tuple(a.smt, a.core_rank, a.package) < make_tuple(b.smt, b.core_rank, b.package);
+        });
+    }
+    vector<int> order;
+    for (const LogicalCpu& cpu : cpus) {
+        order.push_back(cpu.id);
+    }
+    return order;
+}
+
+// Unix domain socket plumbing for --coordinator and --worker.
+sockaddr_un unix_address(const string& path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        fatal("cannot use socket " + path);
+    }
+    strcpy(address.sun_path, path.c_str());
+    return address;
+}
+
+int listen_unix(const string& path) {
+    const sockaddr_un address = unix_address(path);
+    unlink(path.c_str());
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (const sockaddr*) &address, sizeof(address)) || listen(fd, 128)) {
+        fatal("cannot listen on " + path);
+    }
+    return fd;
+}
+
+// Returns -1 if nobody is listening at path.
+int connect_unix(const string& path) {
+    const sockaddr_un address = unix_address(path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (const sockaddr*) &address, sizeof(address))) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Both return false once the peer is gone;  a vanished peer never raises SIGPIPE.
+bool send_all(int fd, const void* data, size_t len) {
+    const char* p = (const char*) data;
+    while (len) {
+        const ssize_t sent = send(fd, p, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        p += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+bool recv_all(int fd, void* data, size_t len) {
+    char* p = (char*) data;
+    while (len) {
+        const ssize_t got = recv(fd, p, len, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        p += got;
+        len -= got;
+    }
+    return true;
+}
+
+void init_known_results(int64_t (&known_results)[64]) {
+    for (int i=0;  i<64; ++i) {
+        known_results[i] = 0;
+    }
+    // There are no published results for n >= 29
+    for (int i = 29;  i<64;  ++i) {
+        if (i % 4 == 3 || i % 4 == 0) {
+            known_results[i] = -1;
+        }
+    }
+    known_results[3]  = 1;
+    known_results[4]  = 0;
+    known_results[7]  = 0;
+    known_results[8]  = 4;
+    known_results[11] = 16;
+    known_results[12] = 40;
+    known_results[15] = 194;
+    known_results[16] = 274;
+    known_results[19] = 2384;
+    known_results[20] = 4719;
+    known_results[23] = 31856;
+    known_results[24] = 62124;
+    known_results[27] = 426502;
+    known_results[28] = 817717;
+}
+
+void report(int n, int64_t cnt, long t_start, long t_end, const int64_t* known_results) {
+    cout << t_end << " Result " << cnt << " for n = " << n;
+    if (n < 0 || n >= 64 || known_results[n] == -1) {
+        cout << " is NEW";
+    } else if (known_results[n] == cnt) {
+        cout << " MATCHES previously published result";
+    } else {
+        cout << " MISMATCHES previously published result " << known_results[n];
+    }
+    cout << " and took " << (t_end - t_start) << " milliseconds to compute.\n";
+    cout << flush;
+}
+
+// Append text to a file with a single O_APPEND write, so that concurrent runs
+// sharing the file never interleave their lines.
+bool append_to_file(const string& path, const string& text) {
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const bool written = write(fd, text.data(), text.size()) == (ssize_t) text.size();
+    const int saved = errno;
+    close(fd);
+    errno = saved;
+    return written;
+}
+
+// The results registry (--registry FILE) is a tab-separated file with one line per
+// completed run;  see RESULTS REGISTRY at the top of this file.
+#ifndef BUILD_HASH
+#define BUILD_HASH "unknown"
+#endif
+
+struct RegistryRecord {
+    int n;
+    int64_t count;
+    long milliseconds;      // wall time of the run
+    long finished;          // unix time in milliseconds
+    string machine;
+    string build;
+};
+
+vector<RegistryRecord> load_registry(const string& path) {
+    vector<RegistryRecord> records;
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) {
+        return records;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') {
+            continue;
+        }
+        line[strcspn(line, "\n")] = 0;
+        vector<string> fields;
+        for (char* field = line;  field;  ) {
+            char* tab = strchr(field, '\t');
+            if (tab) {
+                *tab++ = 0;
+            }
+            fields.push_back(field);
+            field = tab;
+        }
+        if (fields.size() == 6) {
+            records.push_back({atoi(fields[0].c_str()), atoll(fields[1].c_str()), atol(fields[2].c_str()),
+                               atol(fields[3].c_str()), fields[4], fields[5]});
+        }
+    }
+    fclose(f);
+    return records;
+}
+
+// Host name, CPU model and CPU count, e.g. "node17, Intel(R) Xeon(R) CPU E5-2699 v4 @ 2.20GHz, 88 CPUs".
+string machine_fingerprint() {
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    string model = "unknown CPU";
+    if (FILE* f = fopen("/proc/cpuinfo", "r")) {
+        char line[1024];
+        while (fgets(line, sizeof(line), f)) {
+            const char* colon = strchr(line, ':');
+            if (colon && strncmp(line, "model name", 10) == 0) {
+                model = string(colon + 2, strcspn(colon + 2, "\n"));
+                break;
+            }
+        }
+        fclose(f);
     }
-    return unique_count<n>(results);
+    string fingerprint = string(host) + ", " + model + ", " + to_string(thread::hardware_concurrency()) + " CPUs";
+    replace(fingerprint.begin(), fingerprint.end(), '\t', ' ');
+    return fingerprint;
 }
 
+// A registry record that vouches for the result of n, or null.  Where a published
+// result exists, any record matching it will do;  otherwise the records for n must
+// all agree and come from at least two different machines.
+const RegistryRecord* verified_record(const vector<RegistryRecord>& records, int n, const int64_t* known_results) {
+    const RegistryRecord* first = nullptr;
+    bool confirmed = false;
+    for (const RegistryRecord& r : records) {
+        if (r.n != n) {
+            continue;
+        }
+        if (known_results[n] != -1) {
+            if (r.count == known_results[n]) {
+                return &r;
+            }
+        } else if (!first) {
+            first = &r;
+        } else if (r.count != first->count) {
+            return nullptr;
+        } else {
+            confirmed |= (r.machine != first->machine);
+        }
+    }
+    return confirmed ? first : nullptr;
+}
 
-// ----------------------------- crux of solution ends here -------------------------------
-// The rest is boring utilities for pretty printing, argument parsing, validation, etc.
-// ----------------------------------------------------------------------------------------
+// How this binary was built, for the run log:  BUILD_FLAGS if given at compile time,
+// e.g. -DBUILD_FLAGS="\"-O3 -march=native\"", else what the predefined macros tell.
+string build_flags() {
+#ifdef BUILD_FLAGS
+    return BUILD_FLAGS;
+#else
+    string flags;
+#ifdef __OPTIMIZE__
+    flags += "optimized";
+#else
+    flags += "unoptimized";
+#endif
+#ifdef NDEBUG
+    flags += " NDEBUG";
+#endif
+#ifdef __AVX2__
+    flags += " AVX2";
+#endif
+#ifdef __BMI2__
+    flags += " BMI2";
+#endif
+    return flags;
+#endif
+}
 
-// Return number of milliseconds elapsed since Jan 1, 1970 00:00 GMT.
-long unixtime() {
-    // There is the unix way, the navy way, and the C++11 way... apparently.
-    using namespace chrono;
-    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
-    // Using steady_clock instead of system_clock above produces comically incorrect results.
-    // Probably steady_clock has the wrong epoch start.
+// text as a JSON string literal.
+string json_string(const string& text) {
+    string json = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            json += '\\';
+            json += c;
+        } else if ((unsigned char) c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            json += escape;
+        } else {
+            json += c;
+        }
+    }
+    return json + "\"";
 }
 
-void init_known_results(int64_t (&known_results)[64]) {
-    for (int i=0;  i<64; ++i) {
-        known_results[i] = 0;
+string json_seconds(double seconds) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.6f", seconds);
+    return text;
+}
+
+// One line of the run log (--log FILE) for a solved n, or for a stopped one (cnt < 0);
+// see RUN LOG at the top of this file.
+void log_solve(const Options& options, int n, int64_t cnt, int64_t known, double seconds, const PhaseTimes& times) {
+    const string line = string("{\"event\":") + (cnt < 0 ? "\"stopped\"" : "\"solved\"") +
+        ",\"unixtime\":" + to_string(unixtime()) +
+        ",\"n\":" + to_string(n) +
+        ",\"unique\":" + to_string(cnt) +
+        ",\"known\":" + to_string(known) +
+        (options.pair_n_open >= 0 ? ",\"shard\":" + json_string(pair_n_shard(options.pair_n_open, options.pair_n_side)) : "") +
+        ",\"raw\":" + to_string(times.raw) +
+        ",\"threads\":" + to_string(options.num_threads) +
+        ",\"split_depth\":" + to_string(times.split_depth) +
+        ",\"tasks\":" + to_string(times.num_tasks) +
+        ",\"schedule\":" + json_string(!options.sweep.empty() ? "sweep " + options.sweep : options.steal ? "steal" : "static") +
+        ",\"workers\":" + json_string(!options.coordinator_socket.empty() ? "coordinator" :
+                                      options.fork ? "processes" : "threads") +
+        ",\"seconds\":{\"total\":" + json_seconds(seconds) +
+        ",\"plan\":" + json_seconds(times.plan) +
+        ",\"search\":" + json_seconds(times.search) +
+        ",\"spill\":" + json_seconds(times.spill) +
+        ",\"dedup\":" + json_seconds(times.dedup) +
+        ",\"merge\":" + json_seconds(times.merge) +
+        ",\"output\":" + json_seconds(times.output) + "}}\n";
+    if (!append_to_file(options.log_path, line)) {
+        warn("cannot append to " + options.log_path);
     }
-    // There are no published results for n >= 29
-    for (int i = 29;  i<64;  ++i) {
-        if (i % 4 == 3 || i % 4 == 0) {
-            known_results[i] = -1;
-        }
+}
+
+// The first line of the run log for each invocation.
+void log_start(const Options& options, int argc, char** argv) {
+    string command;
+    for (int i=0;  i<argc;  ++i) {
+        command += (i ? " " : "") + string(argv[i]);
+    }
+    const string line = "{\"event\":\"start\",\"unixtime\":" + to_string(unixtime()) +
+        ",\"command\":" + json_string(command) +
+        ",\"threads\":" + to_string(options.num_threads) +
+        ",\"machine\":" + json_string(machine_fingerprint()) +
+        ",\"build\":" + json_string(BUILD_HASH) +
+        ",\"compiler\":" + json_string(__VERSION__) +
+        ",\"flags\":" + json_string(build_flags()) + "}\n";
+    if (!append_to_file(options.log_path, line)) {
+        warn("cannot append to " + options.log_path);
     }
-    known_results[3]  = 1;
-    known_results[4]  = 0;
-    known_results[7]  = 0;
-    known_results[8]  = 4;
-    known_results[11] = 16;
-    known_results[12] = 40;
-    known_results[15] = 194;
-    known_results[16] = 274;
-    known_results[19] = 2384;
-    known_results[20] = 4719;
-    known_results[23] = 31856;
-    known_results[24] = 62124;
-    known_results[27] = 426502;
-    known_results[28] = 817717;
 }
 
-template <int n>
-void print(const Positions<n>& pos) {
-    cout << unixtime() << " Sequence ";
-    int s[2 * n];
-    for (int i=0; i<2*n; ++i) {
-        s[i] = -1;
+// Compare a fresh result with the registry, then append it.
+void record_result(const string& path, int n, int64_t cnt, long milliseconds) {
+    const vector<RegistryRecord> records = load_registry(path);
+    int agree = 0;
+    const RegistryRecord* conflict = nullptr;
+    for (const RegistryRecord& r : records) {
+        if (r.n == n) {
+            if (r.count == cnt) {
+                ++agree;
+            } else if (!conflict) {
+                conflict = &r;
+            }
+        }
     }
-    for (int m=1;  m<=n;  ++m) {
-        int k2 = pos[m-1];
-        int k1 = k2 - m - 1;
-        assert(0 <= k1);
-        assert(k2 < 2*n);
-        assert(s[k1] == -1);
-        assert(s[k2] == -1);
-        s[k1] = s[k2] = m;
+    const RegistryRecord record = {n, cnt, milliseconds, unixtime(), machine_fingerprint(), BUILD_HASH};
+    const string line = to_string(record.n) + "\t" + to_string(record.count) + "\t" +
+        to_string(record.milliseconds) + "\t" + to_string(record.finished) + "\t" + record.machine + "\t" +
+        record.build + "\n";
+    const string header = records.empty() ? "# n\tcount\tmilliseconds\tfinished\tmachine\tbuild\n" : "";
+    if (!append_to_file(path, header + line)) {
+        fatal("cannot append to " + path);
     }
-    for (int i=0;  i<2*n;  ++i) {
-        const int64_t m = s[i];
-        assert(0 <= m);
-        assert(m <= n);
-        cout << setw(3) << m;
+    cout << unixtime() << " Recorded in " << path << ";  " << agree << " earlier runs agree";
+    if (conflict) {
+        cout << ", but it MISMATCHES " << conflict->count << " recorded on " << conflict->machine
+             << " by build " << conflict->build;
     }
     cout << "\n";
+    cout << flush;
 }
 
 template <int n>
-void run(const int64_t* known_results) {
+void run(const Options& options, const int64_t* known_results) {
+    if (options.replay_task >= 0) {
+        cout << unixtime() << " Replaying task " << options.replay_task << " of Planar Langford for n = " << n << "\n";
+        cout << flush;
+        replay<n>(options);
+        return;
+    }
+    if (options.estimate_seconds > 0) {
+        cout << unixtime() << " Estimating Planar Langford for n = " << n << "\n";
+        cout << flush;
+        estimate<n>(options);
+        return;
+    }
+    if (!options.worker_socket.empty()) {
+        cout << unixtime() << " Working on n = " << n << " for the coordinator at " << options.worker_socket << "\n";
+        cout << flush;
+        work<n>(options);
+        return;
+    }
     auto t_start = unixtime();
     cout << t_start << " Solving Planar Langford for n = " << n << "\n";
     cout << flush;
-    int cnt = solve<n>();
+    const double t_solve = monotonic_seconds();
+    PhaseTimes times;
+    vector<TraceRing> trace;
+    int64_t cnt = solve<n>(options, &times, &trace);
     auto t_end = unixtime();
-    cout << t_end << " Result " << cnt << " for n = " << n;
-    if (n < 0 || n >= 64 || known_results[n] == -1) {
-        cout << " is NEW";
-    } else if (known_results[n] == cnt) {
+    const double seconds = monotonic_seconds() - t_solve;
+    if (cnt < 0) {
+        if (!options.log_path.empty()) {
+            log_solve(options, n, cnt, known_results[n], seconds, times);
+        }
+        const bool resumable = !options.emit_in_search_order && options.pair_n_open < 0 && !options.pair_n_all;
+        cout << t_end << " Stopped n = " << n << " after " << (t_end - t_start) << " milliseconds"
+             << (resumable ? ";  rerun with --resume to continue\n" : "\n");
+        cout << flush;
+        exit(kExitStopped);
+    }
+    if (options.pair_n_open >= 0) {
+        cout << t_end << " Shard " << pair_n_shard(options.pair_n_open, options.pair_n_side) << " of n = " << n
+             << " has " << cnt << " solutions, took " << (t_end - t_start) << " milliseconds\n";
+        cout << flush;
+    } else {
+        report(n, cnt, t_start, t_end, known_results);
+        if (!options.registry_path.empty()) {
+            record_result(options.registry_path, n, cnt, t_end - t_start);
+        }
+    }
+    // the log and the trace come after the result is reported and recorded, so that
+    // failing to write them cannot lose it
+    if (!options.log_path.empty()) {
+        log_solve(options, n, cnt, known_results[n], seconds, times);
+    }
+    if (!trace.empty()) {
+        const string path = expand_path(options.trace_path, n);
+        if (write_trace(path, trace)) {
+            cout << unixtime() << " Wrote a trace of " << trace.size() - 1 << " workers to " << path << "\n";
+        } else {
+            warn("cannot write " + path);
+        }
+    }
+}
+
+// Map a run-time n onto the matching run<n>.  Only n with n % 4 == 0 or 3 can
+// have solutions, so only those instantiate the solver;  the rest report 0 right away.
+template <int n, bool possible = (n % 4 == 0 || n % 4 == 3)>
+struct Dispatch {
+    static void run(int target, const Options& options, const int64_t* known_results) {
+        if (target == n) {
+            ::run<n>(options, known_results);
+        } else {
+            Dispatch<n + 1>::run(target, options, known_results);
+        }
+    }
+
+    static SweepJob* sweep_job(int target, const Options& options) {
+        return target == n ? new SweepJobOf<n>(options) : Dispatch<n + 1>::sweep_job(target, options);
+    }
+
+    static PlanarLangfordStats visit(int target, const PlanarLangfordOptions& options,
+                                     const PlanarLangfordVisitor* visitor) {
+        return target == n ? visit_all<n>(options, visitor) : Dispatch<n + 1>::visit(target, options, visitor);
+    }
+
+    static GeneratorState* generator(int target, int shard, int num_shards) {
+        return target == n ? new GeneratorOf<n>(shard, num_shards) :
+                             Dispatch<n + 1>::generator(target, shard, num_shards);
+    }
+};
+
+template <int n>
+struct Dispatch<n, false> {
+    static void run(int target, const Options& options, const int64_t* known_results) {
+        if (target == n) {
+            auto t = unixtime();
+            cout << t << " Solving Planar Langford for n = " << n << "\n";
+            report(n, 0, t, t, known_results);
+        } else {
+            Dispatch<n + 1>::run(target, options, known_results);
+        }
+    }
+
+    // null:  the caller reports 0 right away
+    static SweepJob* sweep_job(int target, const Options& options) {
+        return target == n ? nullptr : Dispatch<n + 1>::sweep_job(target, options);
+    }
+
+    static PlanarLangfordStats visit(int target, const PlanarLangfordOptions& options,
+                                     const PlanarLangfordVisitor* visitor) {
+        return target == n ? PlanarLangfordStats() : Dispatch<n + 1>::visit(target, options, visitor);
+    }
+
+    // null:  there is nothing to generate
+    static GeneratorState* generator(int target, int shard, int num_shards) {
+        return target == n ? nullptr : Dispatch<n + 1>::generator(target, shard, num_shards);
+    }
+};
+
+template <>
+struct Dispatch<kMaxN + 1> {
+    static void run(int target, const Options&, const int64_t*) {
+        cerr << "n = " << target << " is out of range 1.." << kMaxN << "\n";
+    }
+
+    static SweepJob* sweep_job(int target, const Options&) {
+        cerr << "n = " << target << " is out of range 1.." << kMaxN << "\n";
+        return nullptr;
+    }
+
+    static PlanarLangfordStats visit(int, const PlanarLangfordOptions&, const PlanarLangfordVisitor*) {
+        return PlanarLangfordStats();
+    }
+
+    static GeneratorState* generator(int, int, int) {
+        return nullptr;
+    }
+};
+
+// --sweep:  plan every n, then feed all of their tasks through one pool of worker
+// threads;  see SWEEPS at the top of this file.  Each n is finished (counted, emitted,
+// reported, recorded) by whichever worker completes its last task, and its time runs
+// from the start of its planning to that moment.
+void run_sweep(const Options& options, const vector<int>& ns, const int64_t* known_results) {
+    vector<unique_ptr<SweepJob>> jobs;
+    for (int n : ns) {
+        SweepJob* job = Dispatch<1>::sweep_job(n, options);
+        if (job) {
+            jobs.emplace_back(job);
+        } else if (n >= 1 && n <= kMaxN) {
+            Dispatch<1>::run(n, options, known_results);
+        }
+    }
+    vector<pair<SweepJob*, uint32_t>> queue;
+    for (auto& job : jobs) {
+        for (uint32_t i : job->order) {
+            queue.push_back(make_pair(job.get(), i));
+        }
+    }
+    if (options.sweep == "lpt") {
+        // the predicted log subtree sizes of different n are on the same scale
+        stable_sort(queue.begin(), queue.end(), [](const pair<SweepJob*, uint32_t>& a,
+                                                   const pair<SweepJob*, uint32_t>& b) {
+            return a.first->cost[a.second] > b.first->cost[b.second];
+        });
+    }
+    cout << unixtime() << " Sweeping " << jobs.size() << " values of n through " << queue.size()
+         << " tasks on " << options.num_threads << " worker threads\n";
+    cout << flush;
+    mutex print_mtx;
+    atomic<size_t> next_task(0);
+    const double t_sweep = monotonic_seconds();
+    run_on_threads(options.num_threads, [&](int thread_id) {
+        const CpuPin pin(options, thread_id);
+        for (size_t i;  (i = next_task++) < queue.size();  ) {
+            SweepJob* job = queue[i].first;
+            job->run_task(queue[i].second);
+            if (--job->remaining == 0) {
+                lock_guard<mutex> lock(print_mtx);
+                job->times.search = monotonic_seconds() - t_sweep;
+                // finish() sorts on threads of its own, which would inherit this CPU
+                unpin_thread();
+                const int64_t cnt = job->finish();
+                if (!options.affinity_cpus.empty()) {
+                    pin_to_cpu(options.affinity_cpus[thread_id % options.affinity_cpus.size()]);
+                }
+                const long t_end = unixtime();
+                report(job->target_n, cnt, job->t_start, t_end, known_results);
+                if (!options.registry_path.empty()) {
+                    record_result(options.registry_path, job->target_n, cnt, t_end - job->t_start);
+                }
+                if (!options.log_path.empty()) {
+                    const PhaseTimes& times = job->times;
+                    log_solve(options, job->target_n, cnt, known_results[job->target_n],
+                              times.plan + times.search + times.dedup + times.merge + times.output, times);
+                }
+            }
+        }
+    });
+}
+
+// --worker:  ask the coordinator which n and split depth it is serving, solve leased
+// tasks for that n, and repeat for as long as it announces more.  Between sessions the
+// coordinator is busy merging results, so keep knocking for up to kReconnectSeconds.
+constexpr int kReconnectSeconds = 3600;
+
+int run_worker(Options options, const int64_t* known_results) {
+    bool more = true;
+    for (bool first = true;  more;  first = false) {
+        Hello hello;
+        int fd = -1;
+        const long t_give_up = unixtime() + (first ? 0 : kReconnectSeconds * 1000L);
+        while (true) {
+            fd = connect_unix(options.worker_socket);
+            if (fd >= 0 && recv_all(fd, &hello, sizeof(hello))) {
+                break;
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+            if (unixtime() >= t_give_up) {
+                if (first) {
+                    fatal("cannot reach a coordinator at " + options.worker_socket);
+                }
+                return 0;
+            }
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+        close(fd);
+        if (memcmp(hello.magic, "PLANGFRC", 8)) {
+            cerr << options.worker_socket << " is not a planar_mt coordinator\n";
+            return 2;
+        }
+        options.split_depth = hello.split_depth;
+        Dispatch<1>::run(hello.n, options, known_results);
+        more = hello.more;
+    }
+    return 0;
+}
+
+// ---------------------------------- validation ------------------------------------
+// Deliberately shares nothing with the solver except the file format.
+
+// Load a binary or text solution file into n closing positions per record.
+// Returns false, with a message in error, if the file cannot be read or parsed.
+bool load_solutions(const string& path, int& n, vector<int8_t>& pos, string& error) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "cannot open " + path + ": " + strerror(errno);
+        return false;
+    }
+    string data;
+    char chunk[1 << 16];
+    ssize_t r;
+    while ((r = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = "cannot read " + path + ": " + strerror(errno);
+            close(fd);
+            return false;
+        }
+        data.append(chunk, r);
+    }
+    close(fd);
+    if (data.compare(0, 8, "PLANGFRD") == 0) {
+        if (data.size() < 16 || data[8] != 1 || data[9] != 0) {
+            error = "unsupported binary header";
+            return false;
+        }
+        n = uint8_t(data[10]);
+        const int bits = uint8_t(data[11]);
+        size_t record_bytes = 0;
+        for (int i=0;  i<4;  ++i) {
+            record_bytes |= size_t(uint8_t(data[12 + i])) << (8 * i);
+        }
+        if (n < 1 || n > kMaxN || bits < 1 || bits > 8 || record_bytes != size_t(n * bits + 7) / 8 ||
+            (data.size() - 16) % record_bytes) {
+            error = "inconsistent binary header or truncated records";
+            return false;
+        }
+        const size_t count = (data.size() - 16) / record_bytes;
+        pos.resize(count * n);
+        const uint8_t* records = reinterpret_cast<const uint8_t*>(data.data()) + 16;
+        for (size_t i=0;  i<count;  ++i) {
+            const uint8_t* record = records + i * record_bytes;
+            for (int m=0;  m<n;  ++m) {
+                int v = 0;
+                for (int b = m * bits;  b < (m + 1) * bits;  ++b) {
+                    v = (v << 1) | ((record[b / 8] >> (7 - b % 8)) & 1);
+                }
+                pos[i * n + m] = int8_t(v);
+            }
+        }
+        return true;
+    }
+    // text:  one sequence of 2n numbers per line
+    n = 0;
+    size_t line_no = 0;
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t end = data.find('\n', start);
+        if (end == string::npos) {
+            end = data.size();
+        }
+        ++line_no;
+        vector<int> s;
+        const char* p = data.c_str() + start;
+        const char* line_end = data.c_str() + end;
+        while (p < line_end) {
+            char* next;
+            const long v = strtol(p, &next, 10);
+            if (next == p) {
+                break;
+            }
+            s.push_back(v);
+            p = next;
+        }
+        start = end + 1;
+        if (s.empty()) {
+            continue;
+        }
+        if (!n) {
+            n = s.size() / 2;
+        }
+        if (n > kMaxN || s.size() != size_t(2 * n) || s.size() % 2) {
+            error = "line " + to_string(line_no) + " does not hold 2n numbers";
+            return false;
+        }
+        // the closing position of m is its second occurrence;  missing or extra
+        // occurrences are left for the distance check to flag
+        vector<int8_t> closing(n, -1);
+        vector<int> seen(n + 1, 0);
+        for (int i=0;  i<2*n;  ++i) {
+            if (1 <= s[i] && s[i] <= n && ++seen[s[i]] == 2) {
+                closing[s[i] - 1] = i;
+            }
+        }
+        pos.insert(pos.end(), closing.begin(), closing.end());
+    }
+    if (!n) {
+        error = "no records";
+        return false;
+    }
+    return true;
+}
+
+enum {
+    kBadDistance = 1,       // some m is not placed as a pair with m numbers in between
+    kBadCrossing = 2,       // the pairs cannot be drawn above/below without crossing
+    kBadCanonical = 4,      // the mirror image of this record is the canonical one
+};
+
+// Check one record of n closing positions;  returns a combination of kBad* flags.
+int check_solution(const int8_t* pos, int n) {
+    int64_t used[2] = {0, 0};
+    int open[kMaxN];
+    for (int m=1;  m<=n;  ++m) {
+        const int k2 = pos[m - 1];
+        const int k1 = k2 - m - 1;
+        if (k1 < 0 || k2 >= 2 * n || ((used[k1 / 64] >> (k1 % 64)) & 1) || ((used[k2 / 64] >> (k2 % 64)) & 1)) {
+            return kBadDistance;
+        }
+        used[k1 / 64] |= int64_t(1) << (k1 % 64);
+        used[k2 / 64] |= int64_t(1) << (k2 % 64);
+        open[m - 1] = k1;
+    }
+    int flags = 0;
+    if (pos[0] > n) {
+        flags |= kBadCanonical;
+    }
+    // two-color the crossing graph by breadth-first search
+    int side[kMaxN];
+    int queue[kMaxN];
+    for (int i=0;  i<n;  ++i) {
+        side[i] = -1;
+    }
+    for (int root=0;  root<n && !(flags & kBadCrossing);  ++root) {
+        if (side[root] >= 0) {
+            continue;
+        }
+        side[root] = 0;
+        int head = 0, tail = 0;
+        queue[tail++] = root;
+        while (head < tail && !(flags & kBadCrossing)) {
+            const int i = queue[head++];
+            for (int j=0;  j<n;  ++j) {
+                const bool crossing = (open[i] < open[j] && open[j] < pos[i] && pos[i] < pos[j]) ||
+                                      (open[j] < open[i] && open[i] < pos[j] && pos[j] < pos[i]);
+                if (!crossing) {
+                    continue;
+                }
+                if (side[j] < 0) {
+                    side[j] = 1 - side[i];
+                    queue[tail++] = j;
+                } else if (side[j] == side[i]) {
+                    flags |= kBadCrossing;
+                    break;
+                }
+            }
+        }
+    }
+    return flags;
+}
+
+// Validate a solution file;  returns the process exit status.
+int validate(const string& path, const int64_t* known_results) {
+    const long t_start = unixtime();
+    int n;
+    vector<int8_t> pos;
+    string error;
+    if (!load_solutions(path, n, pos, error)) {
+        cerr << "planar_mt: " << path << ": " << error << "\n";
+        return 2;
+    }
+    const size_t count = pos.size() / n;
+    cout << unixtime() << " Validating " << count << " records for n = " << n << " from " << path << "\n";
+    cout << flush;
+    int cpus_allowed, cgroup_limit;
+    const int num_threads = (int) min<size_t>(default_num_threads(cpus_allowed, cgroup_limit), 1 + count / 4096);
+    vector<uint8_t> record_flags(count);
+    vector<array<int64_t, 6>> tallies(num_threads);
+    // tallies[t] = {bad distance, bad crossing, bad canonical, out of order, duplicate, valid}
+    run_on_threads(num_threads, [&](int t) {
+        auto& tally = tallies[t];
+        tally.fill(0);
+        const size_t begin = count * t / num_threads;
+        const size_t end = count * (t + 1) / num_threads;
+        for (size_t i=begin;  i<end;  ++i) {
+            const int8_t* record = &pos[i * n];
+            const int flags = record_flags[i] = check_solution(record, n);
+            tally[0] += (flags & kBadDistance) != 0;
+            tally[1] += (flags & kBadCrossing) != 0;
+            tally[2] += (flags & kBadCanonical) != 0;
+            tally[5] += !flags;
+            if (i) {
+                const int c = memcmp(record - n, record, n);
+                tally[3] += (c > 0);
+                tally[4] += (c == 0 && !flags);
+            }
+        }
+    });
+    array<int64_t, 6> total = {{0, 0, 0, 0, 0, 0}};
+    for (auto& tally : tallies) {
+        for (int j=0;  j<6;  ++j) {
+            total[j] += tally[j];
+        }
+    }
+    if (total[3]) {
+        // not sorted, so adjacent comparisons miss duplicates;  sort the valid ones and recount
+        vector<vector<int8_t>> records;
+        for (size_t i=0;  i<count;  ++i) {
+            if (!record_flags[i]) {
+                records.emplace_back(pos.begin() + i * n, pos.begin() + (i + 1) * n);
+            }
+        }
+        sort(records.begin(), records.end());
+        total[4] = records.size() - (unique(records.begin(), records.end()) - records.begin());
+    }
+    const int64_t valid_unique = total[5] - total[4];
+    const bool ok = !total[0] && !total[1] && !total[2] && !total[4];
+    cout << unixtime() << " " << (ok ? "PASSED" : "FAILED") << ": "
+         << total[0] << " distance errors, " << total[1] << " crossing errors, "
+         << total[2] << " non-canonical, " << total[4] << " duplicates"
+         << (total[3] ? " (records are not sorted)" : "") << "\n";
+    cout << unixtime() << " Count " << valid_unique << " for n = " << n;
+    if (known_results[n] == -1) {
+        cout << " has no previously published result";
+    } else if (known_results[n] == valid_unique) {
         cout << " MATCHES previously published result";
     } else {
         cout << " MISMATCHES previously published result " << known_results[n];
     }
-    cout << " and took " << (t_end - t_start) << " milliseconds to compute.\n";
-    cout << flush;
+    cout << ";  validation took " << (unixtime() - t_start) << " milliseconds.\n";
+    return ok ? 0 : 1;
+}
+
+int usage(const char* argv0) {
+    cerr << "Usage: " << argv0 << " [options] [n ...]    where each n is in 1.." << kMaxN << "\n"
+         << "       " << argv0 << " validate FILE\n"
+         << "\n"
+         << "    --emit FILE                  write all unique solutions to FILE;  \"{n}\" is replaced\n"
+         << "                                 by n, and \"-\" means stdout\n"
+         << "    --emit-format binary|text    format of the emitted solutions (default binary)\n"
+         << "    --emit-order sorted|search   sort all solutions at the end (default), or count and\n"
+         << "                                 emit them task by task in search order, unstored\n"
+         << "    --mem-budget SIZE            spill raw solutions to disk beyond SIZE bytes;  K, M\n"
+         << "                                 and G suffixes are accepted (default unlimited)\n"
+         << "    --spill-dir DIR              directory for spilled runs (default $TMPDIR or /tmp)\n"
+         << "    --threads N                  number of worker threads (default: CPUs available,\n"
+         << "                                 honoring the affinity mask and cgroup CPU quota)\n"
+         << "    --affinity POLICY            pin workers to CPUs:  compact, scatter or physical\n"
+         << "    --split-depth D              cut the search into tasks at depth D (default: the\n"
+         << "                                 shallowest depth with 64 tasks per worker)\n"
+         << "    --task-order cost|natural    claim the most expensive tasks first (default cost),\n"
+         << "                                 or in depth-first order\n"
+         << "    --schedule static|steal      split at a fixed depth up front (default static), or\n"
+         << "                                 split busy workers' stacks whenever a worker is idle\n"
+         << "    --workers threads|processes  run the workers as threads (default) or as forked\n"
+         << "                                 processes, so a crash loses only one task\n"
+         << "    --sweep lpt|ordered          solve all n at once on one pool of workers, claiming\n"
+         << "                                 the largest tasks of any n first (lpt), or the n in\n"
+         << "                                 the order given, each n's largest tasks first\n"
+         << "    --time-limit SECONDS         stop after SECONDS, as on SIGINT or SIGTERM:  save the\n"
+         << "                                 finished tasks and their solutions, and exit with\n"
+         << "                                 status 3\n"
+         << "    --progress FILE              where to save them (default planar_mt_n{n}.progress)\n"
+         << "    --resume FILE                continue from such a file, if it exists\n"
+         << "    --log FILE                   append a JSON line per run and per n, with the time of\n"
+         << "                                 each phase (plan, search, spill, dedup, merge, output)\n"
+         << "    --trace FILE                 write a Chrome trace of the worker threads to FILE\n"
+         << "                                 ({n} is replaced by n), for ui.perfetto.dev\n"
+         << "    --metrics FILE               write Prometheus metrics to FILE (atomically replaced)\n"
+         << "    --metrics-interval SECONDS   how often (default 15)\n"
+         << "    --registry FILE              append each result to FILE, and skip any n whose\n"
+         << "                                 result FILE already verifies\n"
+         << "    --force                      solve such n anyway\n"
+         << "    --coordinator SOCKET         lease the tasks to --worker processes over a Unix socket\n"
+         << "    --worker SOCKET              solve the tasks of the coordinator at SOCKET;  n and the\n"
+         << "                                 split depth come from the coordinator\n"
+         << "    --lease-timeout SECONDS      re-issue leases older than this (default 3600, 0 = never)\n"
+         << "    --pair-n P@below|P@above     solve only the shard in which the pair n opens at\n"
+         << "                                 position P and is drawn below or above;  \"all\"\n"
+         << "                                 solves every shard in turn and reports each\n"
+         << "    --replay-task ID             do not solve;  search only frontier task ID on one\n"
+         << "                                 thread, for profiling (with --split-depth, or the\n"
+         << "                                 same --threads as the run that named it)\n"
+         << "    --estimate SECONDS           do not solve;  predict the tree size and wall time\n"
+         << "                                 from SECONDS of random probes and timed searches\n";
+    return 1;
+}
+
+// Parse a byte count with an optional K, M or G suffix.
+bool parse_size(const string& text, size_t& bytes) {
+    char* end;
+    const unsigned long long value = strtoull(text.c_str(), &end, 10);
+    int shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+    } else if (*end == 'G' || *end == 'g') {
+        shift = 30;
+    }
+    if (end == text.c_str() || (shift && *++end) || (!shift && *end)) {
+        return false;
+    }
+    bytes = size_t(value) << shift;
+    return true;
+}
+
+// Fill in options from the command line.  Returns false on a malformed command line.
+bool parse_args(int argc, char** argv, Options& options) {
+    for (int i=1;  i<argc;  ++i) {
+        const string arg = argv[i];
+        if (arg == "--force") {
+            options.force = true;
+            continue;
+        }
+        if (arg.compare(0, 2, "--") == 0) {
+            if (i + 1 == argc) {
+                return false;
+            }
+            const string value = argv[++i];
+            if (arg == "--emit") {
+                options.emit_path = value;
+            } else if (arg == "--emit-format" && (value == "binary" || value == "text")) {
+                options.emit_binary = (value == "binary");
+            } else if (arg == "--emit-order" && (value == "sorted" || value == "search")) {
+                options.emit_in_search_order = (value == "search");
+            } else if (arg == "--mem-budget" && parse_size(value, options.mem_budget)) {
+            } else if (arg == "--spill-dir") {
+                options.spill_dir = value;
+            } else if (arg == "--threads") {
+                char* end;
+                options.num_threads = strtol(value.c_str(), &end, 10);
+                if (*end || options.num_threads < 1) {
+                    return false;
+                }
+            } else if (arg == "--split-depth") {
+                char* end;
+                options.split_depth = strtol(value.c_str(), &end, 10);
+                if (*end || options.split_depth < 1) {
+                    return false;
+                }
+            } else if (arg == "--task-order" && (value == "cost" || value == "natural")) {
+                options.order_by_cost = (value == "cost");
+            } else if (arg == "--schedule" && (value == "static" || value == "steal")) {
+                options.steal = (value == "steal");
+            } else if (arg == "--workers" && (value == "threads" || value == "processes")) {
+                options.fork = (value == "processes");
+            } else if (arg == "--sweep" && (value == "lpt" || value == "ordered")) {
+                options.sweep = value;
+            } else if (arg == "--time-limit") {
+                char* end;
+                const double seconds = strtod(value.c_str(), &end);
+                if (*end || seconds <= 0) {
+                    return false;
+                }
+                options.deadline = monotonic_seconds() + seconds;
+            } else if (arg == "--progress") {
+                options.progress_path = value;
+            } else if (arg == "--resume") {
+                options.progress_path = value;
+                options.resume = true;
+            } else if (arg == "--pair-n" && value == "all") {
+                options.pair_n_all = true;
+            } else if (arg == "--pair-n") {
+                // P@below or P@above
+                const size_t at = value.find('@');
+                const string side = at == string::npos ? "" : value.substr(at + 1);
+                char* end;
+                options.pair_n_open = strtol(value.substr(0, at).c_str(), &end, 10);
+                if (at == 0 || *end || options.pair_n_open < 0 || (side != "below" && side != "above")) {
+                    return false;
+                }
+                options.pair_n_side = (side == "above");
+            } else if (arg == "--replay-task") {
+                char* end;
+                options.replay_task = strtoll(value.c_str(), &end, 10);
+                if (*end || options.replay_task < 0) {
+                    return false;
+                }
+            } else if (arg == "--trace") {
+                options.trace_path = value;
+            } else if (arg == "--log") {
+                options.log_path = value;
+            } else if (arg == "--metrics") {
+                options.metrics_path = value;
+            } else if (arg == "--metrics-interval") {
+                char* end;
+                options.metrics_interval = strtod(value.c_str(), &end);
+                if (*end || options.metrics_interval <= 0) {
+                    return false;
+                }
+            } else if (arg == "--registry") {
+                options.registry_path = value;
+            } else if (arg == "--coordinator") {
+                options.coordinator_socket = value;
+            } else if (arg == "--worker") {
+                options.worker_socket = value;
+            } else if (arg == "--lease-timeout") {
+                char* end;
+                options.lease_timeout = strtod(value.c_str(), &end);
+                if (*end || options.lease_timeout < 0) {
+                    return false;
+                }
+            } else if (arg == "--estimate") {
+                char* end;
+                options.estimate_seconds = strtod(value.c_str(), &end);
+                if (*end || !(options.estimate_seconds > 0)) {
+                    return false;
+                }
+            } else if (arg == "--affinity" && (value == "compact" || value == "scatter" || value == "physical")) {
+                options.affinity = value;
+            } else {
+                return false;
+            }
+            continue;
+        }
+        if (arg == "validate") {
+            if (i + 1 == argc) {
+                return false;
+            }
+            options.validate_path = argv[++i];
+            continue;
+        }
+        char* end;
+        const long n = strtol(argv[i], &end, 10);
+        if (*end || n < 1 || n > kMaxN) {
+            return false;
+        }
+        options.ns.push_back(n);
+    }
+    if (options.ns.empty()) {
+        options.ns = {3, 4, 7, 8, 11, 12, 15, 16, 19, 20, 23, 24, 27, 28};
+    }
+    if (options.ns.size() > 1 && !options.emit_path.empty() &&
+        options.emit_path != "-" && options.emit_path.find("{n}") == string::npos) {
+        cerr << "--emit FILE must contain {n} when solving more than one n\n";
+        return false;
+    }
+    if (!options.coordinator_socket.empty() && (options.steal || !options.worker_socket.empty())) {
+        cerr << "--coordinator cannot be combined with --schedule steal or --worker\n";
+        return false;
+    }
+    if (!options.sweep.empty() && (options.steal || options.fork || options.estimate_seconds > 0 ||
+                                   !options.coordinator_socket.empty() || !options.worker_socket.empty())) {
+        cerr << "--sweep runs threads on a static frontier;  it combines with none of --schedule steal,\n"
+             << "--workers processes, --coordinator, --worker, --estimate\n";
+        return false;
+    }
+    if (!options.metrics_path.empty() &&
+        (options.fork || !options.coordinator_socket.empty() || !options.worker_socket.empty() || !options.sweep.empty())) {
+        cerr << "--metrics needs the solver's own worker threads, without --sweep\n";
+        return false;
+    }
+    if (!options.trace_path.empty() &&
+        (options.fork || !options.coordinator_socket.empty() || !options.worker_socket.empty() || !options.sweep.empty())) {
+        cerr << "--trace needs the solver's own worker threads, without --sweep\n";
+        return false;
+    }
+    if (options.ns.size() > 1 && options.trace_path.find("{n}") == string::npos && !options.trace_path.empty()) {
+        cerr << "--trace FILE must contain {n} when solving more than one n\n";
+        return false;
+    }
+    if ((options.deadline || options.resume) &&
+        (options.steal || options.fork || !options.coordinator_socket.empty() || !options.sweep.empty())) {
+        cerr << "--time-limit and --resume need the default thread workers on a static frontier\n";
+        return false;
+    }
+    if (options.replay_task >= 0 &&
+        (options.ns.size() != 1 || options.steal || options.fork || options.estimate_seconds > 0 ||
+         !options.coordinator_socket.empty() || !options.worker_socket.empty() || !options.sweep.empty())) {
+        cerr << "--replay-task needs exactly one n and combines with none of --schedule steal,\n"
+             << "--workers processes, --coordinator, --worker, --sweep, --estimate\n";
+        return false;
+    }
+    if ((options.pair_n_open >= 0 || options.pair_n_all) &&
+        (options.steal || options.fork || options.deadline || options.resume || !options.coordinator_socket.empty() ||
+         !options.worker_socket.empty() || !options.sweep.empty() || !options.metrics_path.empty() ||
+         !options.trace_path.empty() || options.replay_task >= 0 || !options.registry_path.empty())) {
+        cerr << "--pair-n solves shards as --emit-order search does;  it combines with none of\n"
+             << "--time-limit, --resume, --metrics, --trace, --replay-task, --registry\n";
+        return false;
+    }
+    if (options.pair_n_all && !options.emit_path.empty()) {
+        cerr << "--pair-n all only counts;  emit shards one at a time\n";
+        return false;
+    }
+    if (options.pair_n_open >= 0 && (options.ns.size() != 1 || options.pair_n_open > options.ns[0] - 2)) {
+        cerr << "--pair-n P@SIDE needs exactly one n, and P in 0..n-2\n";
+        return false;
+    }
+    if (options.emit_in_search_order &&
+        (options.steal || options.fork || options.deadline || options.resume || !options.coordinator_socket.empty() ||
+         !options.sweep.empty() || !options.metrics_path.empty() || !options.trace_path.empty())) {
+        cerr << "--emit-order search needs the default thread workers on a static frontier, and combines\n"
+             << "with none of --time-limit, --resume, --metrics, --trace\n";
+        return false;
+    }
+    if (options.fork && (options.steal || !options.coordinator_socket.empty())) {
+        cerr << "--workers processes cannot be combined with --schedule steal or --coordinator\n";
+        return false;
+    }
+    if (!options.metrics_path.empty() && !can_create(options.metrics_path)) {
+        cerr << "--metrics " << options.metrics_path << ":  cannot write there:  " << strerror(errno) << "\n";
+        return false;
+    }
+    for (int n : options.ns) {
+        const string path = expand_path(options.trace_path, n);
+        if (!options.trace_path.empty() && !can_create(path)) {
+            cerr << "--trace " << path << ":  cannot write there:  " << strerror(errno) << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+// The library interface;  see planar_langford.h.
+PlanarLangfordStats count_planar_langford(int n, const PlanarLangfordOptions& options) {
+    return Dispatch<1>::visit(n, options, nullptr);
+}
+
+PlanarLangfordStats for_each_planar_langford(int n, const PlanarLangfordVisitor& visitor,
+                                             const PlanarLangfordOptions& options) {
+    return Dispatch<1>::visit(n, options, &visitor);
+}
+
+struct PlanarLangfordGenerator::State {
+    unique_ptr<GeneratorState> search;  // null for n without solutions
+};
+
+PlanarLangfordGenerator::PlanarLangfordGenerator(int n, int shard, int num_shards) : state(new State) {
+    if (0 <= shard && shard < num_shards) {
+        state->search.reset(Dispatch<1>::generator(n, shard, num_shards));
+    }
+}
+
+PlanarLangfordGenerator::~PlanarLangfordGenerator() {
+}
+
+bool PlanarLangfordGenerator::next(int* sequence) {
+    return state->search && state->search->next(sequence);
 }
 
+#ifndef PLANAR_LANGFORD_NO_MAIN
 int main(int argc, char **argv) {
+    Options options;
+    if (!parse_args(argc, argv, options)) {
+        return usage(argv[0]);
+    }
+    if (options.emit_path == "-") {
+        // Keep the status lines out of the emitted records.
+        cout.rdbuf(cerr.rdbuf());
+    }
     int64_t known_results[64];
     init_known_results(known_results);
-    run<3>(known_results);
-    run<4>(known_results);
-    run<7>(known_results);
-    run<8>(known_results);
-    run<11>(known_results);
-    run<12>(known_results);
-    run<15>(known_results);
-    run<16>(known_results);
-    run<19>(known_results);
-    run<20>(known_results);
-    run<23>(known_results);
-    run<24>(known_results);
-    run<27>(known_results);
-    run<28>(known_results);
+    if (!options.validate_path.empty()) {
+        return validate(options.validate_path, known_results);
+    }
+    int cpus_allowed, cgroup_limit;
+    const int default_threads = default_num_threads(cpus_allowed, cgroup_limit);
+    if (!options.affinity.empty()) {
+        options.affinity_cpus = affinity_order(options.affinity);
+    }
+    if (!options.num_threads) {
+        // One worker per CPU of the placement order, e.g. per physical core with
+        // --affinity physical, so that no two default workers share a CPU.
+        options.num_threads = options.affinity_cpus.empty() ? default_threads :
+                              min(default_threads, (int) options.affinity_cpus.size());
+    }
+    cout << unixtime() << " Using " << options.num_threads << " worker threads;  " << cpus_allowed
+         << " CPUs in the affinity mask, cgroup CPU quota ";
+    if (cgroup_limit) {
+        cout << cgroup_limit << "\n";
+    } else {
+        cout << "unlimited\n";
+    }
+    if (!options.affinity.empty()) {
+        cout << unixtime() << " Pinning workers to " << options.affinity_cpus.size() << " CPUs ("
+             << options.affinity << "):";
+        for (int cpu : options.affinity_cpus) {
+            cout << " " << cpu;
+        }
+        cout << "\n";
+    }
+    if (!options.worker_socket.empty()) {
+        return run_worker(options, known_results);
+    }
+    const vector<RegistryRecord> registry = load_registry(options.registry_path);
+    vector<int> ns;
+    for (int n : options.ns) {
+        const RegistryRecord* verified = verified_record(registry, n, known_results);
+        if (verified && !options.force && options.estimate_seconds == 0 && options.replay_task < 0) {
+            cout << unixtime() << " Skipping n = " << n << ":  result " << verified->count
+                 << " was verified on " << verified->machine << " (--force recomputes)\n";
+            continue;
+        }
+        ns.push_back(n);
+    }
+    // from here on, options.ns lists only the n to be solved, e.g. for Hello::more
+    options.ns = ns;
+    if (!options.log_path.empty()) {
+        log_start(options, argc, argv);
+    }
+    if (!options.sweep.empty()) {
+        run_sweep(options, ns, known_results);
+        return 0;
+    }
+    if (options.coordinator_socket.empty() && !options.fork && !options.steal) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = request_stop;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+    }
+    for (int n : ns) {
+        Dispatch<1>::run(n, options, known_results);
+    }
     return 0;
 }
+#endif